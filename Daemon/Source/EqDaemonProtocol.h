@@ -0,0 +1,131 @@
+/*
+  ==============================================================================
+
+    Shared-memory layout between the EQ daemon and its clients.
+
+    The daemon creates one region holding a header and a fixed number of
+    stream slots. A client claims a free slot, writes its configuration and
+    then exchanges audio through the slot's block ring: it fills a block,
+    bumps `submitted` and rings its worker's doorbell; the daemon processes
+    the block in place and bumps `completed`. Both counters and the doorbells
+    are futex words, so neither side spins and no audio is ever copied.
+    A block can carry parameter changes stamped with the sample they take
+    effect at, which the daemon applies sample-accurately.
+
+    Only plain, fixed-size types live here so the header can be included by
+    clients that do not link the EQ itself.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace EqDaemon {
+
+    constexpr uint32_t regionMagic = 0x44515145; // "EQQD"
+    constexpr uint32_t protocolVersion = 2;
+    constexpr const char* defaultRegionName = "/eqpt-daemon";
+
+    constexpr int maxWorkers = 64;
+    constexpr int maxChannelsPerStream = 8;
+    constexpr int maxBlockSize = 2048;
+    constexpr int ringBlocks = 8;
+    constexpr int maxStateBytes = 8192;
+    constexpr int maxEventsPerBlock = 32;
+
+    using FutexWord = std::atomic<uint32_t>;
+    static_assert(sizeof(FutexWord) == sizeof(uint32_t) && FutexWord::is_always_lock_free, "futex words must be plain 32-bit integers");
+
+    // Keeps each worker's doorbell on its own cache line.
+    struct alignas(64) PaddedFutexWord
+    {
+        FutexWord word;
+    };
+
+    enum SlotState : uint32_t
+    {
+        Slot_Free = 0,
+        Slot_Reserved,  // client owns the slot and is writing its configuration, starting with its pid
+        Slot_Claimed,   // configuration complete, waiting for the daemon to build an engine
+        Slot_Active,    // engine ready, blocks are being processed
+        Slot_Closing,   // client is done, daemon tears the engine down and frees the slot
+    };
+
+    // A parameter change at a sample of its block. The key is ParameterKey::fromID() of the parameter ID
+    // (Source/ParameterKey.h) and the value is in the parameter's own units, e.g. dB or Hz.
+    struct ParameterEventRecord
+    {
+        uint32_t parameterKey;
+        float value;
+        uint32_t sampleOffset;
+    };
+
+    struct BlockHeader
+    {
+        uint64_t submitTimeNs;
+        uint32_t numSamples;
+        uint32_t numEvents;
+        ParameterEventRecord events[maxEventsPerBlock];
+    };
+
+    // Written by the daemon, readable by the client at any time.
+    struct StreamStats
+    {
+        std::atomic<uint64_t> blocksProcessed;
+        std::atomic<uint64_t> samplesProcessed;
+        std::atomic<uint64_t> totalLatencyNs;
+        std::atomic<uint64_t> maxLatencyNs;
+        std::atomic<uint64_t> totalProcessNs;
+    };
+
+    // A slot still reserved without a pid a couple of seconds after it was claimed is freed again.
+    struct alignas(64) StreamSlot
+    {
+        FutexWord state;
+        int32_t clientPid;
+        uint32_t numChannels;
+        uint32_t blockSize;
+        // Parameter events closer together than this many samples share a filter update; 0 keeps the default
+        uint32_t minSegmentLength;
+        double sampleRate;
+
+        // Monotonic block counters; the ring position is the counter modulo ringBlocks.
+        alignas(64) FutexWord submitted;
+        alignas(64) FutexWord completed;
+
+        // Seqlock around the parameter blob: odd while the client is writing it.
+        // The blob is anything EqPTAudioProcessor::setStateInformation accepts.
+        alignas(64) FutexWord stateSequence;
+        uint32_t stateSize;
+        uint8_t stateData[maxStateBytes];
+
+        StreamStats stats;
+
+        BlockHeader blocks[ringBlocks];
+        alignas(64) float audio[ringBlocks][maxChannelsPerStream][maxBlockSize];
+    };
+
+    struct alignas(64) RegionHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t numSlots;
+        uint32_t numWorkers;
+
+        // Slot n is served by worker n % numWorkers, which sleeps on its own doorbell.
+        PaddedFutexWord workerDoorbells[maxWorkers];
+    };
+
+    inline size_t getRegionSize(uint32_t numSlots)
+    {
+        return sizeof(RegionHeader) + static_cast<size_t>(numSlots) * sizeof(StreamSlot);
+    }
+
+    inline StreamSlot* getSlots(RegionHeader* header)
+    {
+        return reinterpret_cast<StreamSlot*>(reinterpret_cast<uint8_t*>(header) + sizeof(RegionHeader));
+    }
+}
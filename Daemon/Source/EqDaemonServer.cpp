@@ -0,0 +1,349 @@
+/*
+  ==============================================================================
+
+    Hosts one EqPTAudioProcessor per client stream on top of the shared
+    memory region and schedules the streams across a fixed worker pool.
+
+  ==============================================================================
+*/
+
+#include "EqDaemonServer.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <signal.h>
+#include <thread>
+
+using namespace EqDaemon;
+
+class EqDaemonServer::Worker : public juce::Thread
+{
+public:
+    Worker(EqDaemonServer& server, int index)
+        : juce::Thread("EqPT daemon worker " + juce::String(index)), m_Server(server), m_Index(index)
+    {
+    }
+
+    void run() override
+    {
+        auto& doorbell = m_Server.m_Header->workerDoorbells[m_Index].word;
+        const auto numSlots = m_Server.m_Options.numSlots;
+        const auto numWorkers = m_Server.m_Options.numWorkers;
+
+        while (!threadShouldExit()) {
+            // Read the doorbell before scanning so a submit racing with the scan is never slept through
+            const auto seen = doorbell.load(std::memory_order_acquire);
+            auto didWork = false;
+            for (int slot = m_Index; slot < numSlots; slot += numWorkers) {
+                didWork |= m_Server.serviceSlot(slot);
+            }
+            if (!didWork) {
+                Futex::wait(doorbell, seen, 100);
+            }
+        }
+    }
+
+    void ring()
+    {
+        auto& doorbell = m_Server.m_Header->workerDoorbells[m_Index].word;
+        doorbell.fetch_add(1, std::memory_order_release);
+        Futex::wake(doorbell, 1);
+    }
+
+private:
+    EqDaemonServer& m_Server;
+    const int m_Index;
+};
+
+EqDaemonServer::EqDaemonServer(const Options& options)
+    : m_Options(options)
+{
+    m_Options.numSlots = juce::jlimit(1, 1024, m_Options.numSlots);
+    m_Options.numWorkers = juce::jlimit(1, maxWorkers, m_Options.numWorkers);
+}
+
+EqDaemonServer::~EqDaemonServer()
+{
+    stop();
+}
+
+bool EqDaemonServer::start(juce::String& error)
+{
+    const auto numSlots = static_cast<uint32_t>(m_Options.numSlots);
+    if (!m_Region.create(m_Options.regionName.toStdString(), getRegionSize(numSlots))) {
+        error = m_Region.getLastError();
+        return false;
+    }
+
+    m_Header = static_cast<RegionHeader*>(m_Region.getData());
+    m_Slots = getSlots(m_Header);
+    m_Header->numSlots = numSlots;
+    m_Header->numWorkers = static_cast<uint32_t>(m_Options.numWorkers);
+    m_Header->version = protocolVersion;
+
+    for (int i = 0; i < m_Options.numSlots; ++i) {
+        m_Engines.push_back(std::make_unique<StreamEngine>());
+    }
+    for (int i = 0; i < m_Options.numWorkers; ++i) {
+        m_Workers.add(new Worker(*this, i))->startThread();
+    }
+
+    // Clients check the magic last, so they never attach to a half-initialised region
+    std::atomic_thread_fence(std::memory_order_release);
+    m_Header->magic = regionMagic;
+    return true;
+}
+
+void EqDaemonServer::stop()
+{
+    for (auto* worker : m_Workers) {
+        worker->signalThreadShouldExit();
+        worker->ring();
+    }
+    for (auto* worker : m_Workers) {
+        worker->stopThread(2000);
+    }
+    m_Workers.clear();
+
+    if (m_Header != nullptr) {
+        for (int i = 0; i < m_Options.numSlots; ++i) {
+            if (m_Engines[static_cast<size_t>(i)]->processor != nullptr) {
+                retire(i);
+            }
+        }
+        m_Header->magic = 0;
+    }
+    m_Engines.clear();
+    m_Region.close();
+    m_Header = nullptr;
+    m_Slots = nullptr;
+}
+
+void EqDaemonServer::housekeep()
+{
+    for (int i = 0; i < m_Options.numSlots; ++i) {
+        auto& slot = m_Slots[i];
+        const auto state = slot.state.load(std::memory_order_acquire);
+        if (state != Slot_Reserved) {
+            m_Engines[static_cast<size_t>(i)]->unownedSinceMs.reset();
+        }
+
+        if (state == Slot_Claimed) {
+            admit(i);
+        }
+        else if (state == Slot_Active) {
+            // State goes through the tree state, which belongs to the message thread, as it would in a plugin host
+            applyPendingState(*m_Engines[static_cast<size_t>(i)], slot);
+        }
+        else if (state == Slot_Closing) {
+            retire(i);
+        }
+        else if (state == Slot_Reserved && slot.clientPid <= 0) {
+            // The client claims the slot before writing its pid; if it died in between, nobody else ever frees the slot
+            auto& engine = *m_Engines[static_cast<size_t>(i)];
+            const auto nowMs = juce::Time::getMillisecondCounter();
+            if (!engine.unownedSinceMs.has_value()) {
+                engine.unownedSinceMs = nowMs;
+            }
+            else if (nowMs - *engine.unownedSinceMs > unownedSlotTimeoutMs) {
+                auto expected = state;
+                if (slot.state.compare_exchange_strong(expected, Slot_Free)) {
+                    Futex::wake(slot.state, INT_MAX);
+                }
+                engine.unownedSinceMs.reset();
+            }
+        }
+        else if (state != Slot_Free && slot.clientPid > 0 && kill(slot.clientPid, 0) != 0 && errno == ESRCH) {
+            // The client died without closing; reclaim the slot
+            auto expected = state;
+            if (slot.state.compare_exchange_strong(expected, Slot_Closing)) {
+                retire(i);
+            }
+        }
+    }
+}
+
+void EqDaemonServer::admit(int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+    auto& engine = *m_Engines[static_cast<size_t>(slotIndex)];
+    const auto numChannels = static_cast<int>(slot.numChannels);
+    const auto blockSize = static_cast<int>(slot.blockSize);
+
+    if (numChannels < 1 || numChannels > maxChannelsPerStream || blockSize < 1 || blockSize > maxBlockSize || slot.sampleRate <= 0.0) {
+        std::cerr << "Rejecting stream " << slotIndex << ": unsupported configuration" << std::endl;
+        slot.state.store(Slot_Free, std::memory_order_release);
+        Futex::wake(slot.state, INT_MAX);
+        return;
+    }
+
+    engine.processor = std::make_unique<EqPTAudioProcessor>();
+    engine.processor->setPlayConfigDetails(numChannels, numChannels, slot.sampleRate, blockSize);
+    engine.processor->prepareToPlay(slot.sampleRate, blockSize);
+    if (slot.minSegmentLength > 0) {
+        engine.processor->setMinimumSegmentLength(static_cast<int>(juce::jmin(slot.minSegmentLength, slot.blockSize)));
+    }
+    engine.midi.clear();
+    engine.appliedStateSequence = 0;
+    applyPendingState(engine, slot);
+
+    resetStats(slot.stats);
+    engine.reportedBlocks = 0;
+    engine.reportedSamples = 0;
+    engine.reportedLatencyNs = 0;
+
+    slot.state.store(Slot_Active, std::memory_order_release);
+    Futex::wake(slot.state, INT_MAX);
+    m_Workers[slotIndex % m_Options.numWorkers]->ring();
+}
+
+void EqDaemonServer::retire(int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+    auto& engine = *m_Engines[static_cast<size_t>(slotIndex)];
+
+    // The slot is no longer Active, so a worker can at most be finishing the pass it already started
+    while (engine.isInUse.load()) {
+        std::this_thread::yield();
+    }
+    if (engine.processor != nullptr) {
+        engine.processor->releaseResources();
+        engine.processor.reset();
+    }
+
+    slot.clientPid = 0;
+    slot.state.store(Slot_Free, std::memory_order_release);
+    Futex::wake(slot.state, INT_MAX);
+}
+
+bool EqDaemonServer::serviceSlot(int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+    auto& engine = *m_Engines[static_cast<size_t>(slotIndex)];
+
+    // Pairs with retire(): either we see the slot leave Active, or retire() sees us in use and waits
+    engine.isInUse.store(true);
+    if (slot.state.load() != Slot_Active) {
+        engine.isInUse.store(false);
+        return false;
+    }
+
+    auto completed = slot.completed.load(std::memory_order_relaxed);
+    const auto submitted = slot.submitted.load(std::memory_order_acquire);
+    if (completed == submitted) {
+        engine.isInUse.store(false);
+        return false;
+    }
+
+    const auto numChannels = static_cast<int>(slot.numChannels);
+    std::array<float*, maxChannelsPerStream> channels;
+    while (completed != submitted) {
+        const auto ringIndex = completed % ringBlocks;
+        const auto& block = slot.blocks[ringIndex];
+        const auto numSamples = juce::jlimit(0, static_cast<int>(slot.blockSize), static_cast<int>(block.numSamples));
+        const auto submitTimeNs = block.submitTimeNs;
+
+        // The buffer refers straight to the client's samples, which are processed in place
+        for (int ch = 0; ch < numChannels; ++ch) {
+            channels[static_cast<size_t>(ch)] = slot.audio[ringIndex][ch];
+        }
+        juce::AudioBuffer<float> buffer(channels.data(), numChannels, numSamples);
+
+        // This worker is the only one serving the slot, so it is the event queue's single producer
+        const auto numEvents = juce::jmin(static_cast<int>(block.numEvents), maxEventsPerBlock);
+        for (int e = 0; e < numEvents; ++e) {
+            const auto& event = block.events[e];
+            if (const auto parameter = Params::findParameter(event.parameterKey)) {
+                engine.processor->pushParameterEvent(*parameter, event.value, static_cast<int>(juce::jmin(event.sampleOffset, static_cast<uint32_t>(numSamples))));
+            }
+        }
+
+        const auto startNs = Futex::nowNs();
+        engine.processor->processBlock(buffer, engine.midi);
+        const auto endNs = Futex::nowNs();
+
+        // Once completed moves on the client may reuse the block, so nothing in it is touched afterwards
+        slot.completed.store(++completed, std::memory_order_release);
+        Futex::wake(slot.completed, INT_MAX);
+
+        auto& stats = slot.stats;
+        const auto latencyNs = endNs - submitTimeNs;
+        stats.blocksProcessed.fetch_add(1, std::memory_order_relaxed);
+        stats.samplesProcessed.fetch_add(static_cast<uint64_t>(numSamples), std::memory_order_relaxed);
+        stats.totalLatencyNs.fetch_add(latencyNs, std::memory_order_relaxed);
+        stats.totalProcessNs.fetch_add(endNs - startNs, std::memory_order_relaxed);
+        if (latencyNs > stats.maxLatencyNs.load(std::memory_order_relaxed)) {
+            stats.maxLatencyNs.store(latencyNs, std::memory_order_relaxed);
+        }
+    }
+
+    engine.isInUse.store(false);
+    return true;
+}
+
+void EqDaemonServer::applyPendingState(StreamEngine& engine, StreamSlot& slot)
+{
+    const auto sequence = slot.stateSequence.load(std::memory_order_acquire);
+    if (sequence == engine.appliedStateSequence || (sequence & 1u) != 0) {
+        return;
+    }
+
+    const auto size = juce::jmin(slot.stateSize, static_cast<uint32_t>(maxStateBytes));
+    std::memcpy(engine.stateScratch.data(), slot.stateData, size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.stateSequence.load(std::memory_order_relaxed) != sequence) {
+        // The client rewrote the blob while we copied it; pick it up on the next pass
+        return;
+    }
+
+    if (size > 0) {
+        engine.processor->setStateInformation(engine.stateScratch.data(), static_cast<int>(size));
+    }
+    engine.appliedStateSequence = sequence;
+}
+
+void EqDaemonServer::resetStats(StreamStats& stats)
+{
+    stats.blocksProcessed = 0;
+    stats.samplesProcessed = 0;
+    stats.totalLatencyNs = 0;
+    stats.maxLatencyNs = 0;
+    stats.totalProcessNs = 0;
+}
+
+juce::StringArray EqDaemonServer::takeStatsReport(double elapsedSeconds)
+{
+    juce::StringArray lines;
+    if (elapsedSeconds <= 0.0) {
+        return lines;
+    }
+
+    for (int i = 0; i < m_Options.numSlots; ++i) {
+        auto& slot = m_Slots[i];
+        auto& engine = *m_Engines[static_cast<size_t>(i)];
+        if (slot.state.load(std::memory_order_acquire) != Slot_Active) {
+            continue;
+        }
+
+        const auto blocks = slot.stats.blocksProcessed.load(std::memory_order_relaxed);
+        const auto samples = slot.stats.samplesProcessed.load(std::memory_order_relaxed);
+        const auto latencyNs = slot.stats.totalLatencyNs.load(std::memory_order_relaxed);
+        const auto newBlocks = blocks - engine.reportedBlocks;
+        const auto samplesPerSecond = static_cast<double>(samples - engine.reportedSamples) / elapsedSeconds;
+        const auto meanLatencyUs = newBlocks > 0 ? static_cast<double>(latencyNs - engine.reportedLatencyNs) / static_cast<double>(newBlocks) / 1000.0 : 0.0;
+
+        lines.add("stream " + juce::String(i)
+                  + " (pid " + juce::String(slot.clientPid) + "): "
+                  + juce::String(static_cast<double>(newBlocks) / elapsedSeconds, 1) + " blocks/s, "
+                  + juce::String(samplesPerSecond / slot.sampleRate, 2) + "x realtime, latency mean "
+                  + juce::String(meanLatencyUs, 1) + " us, lifetime max "
+                  + juce::String(static_cast<double>(slot.stats.maxLatencyNs.load(std::memory_order_relaxed)) / 1000.0, 1) + " us");
+
+        engine.reportedBlocks = blocks;
+        engine.reportedSamples = samples;
+        engine.reportedLatencyNs = latencyNs;
+    }
+    return lines;
+}
@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    Hosts one EqPTAudioProcessor per client stream on top of the shared
+    memory region and schedules the streams across a fixed worker pool.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SharedMemoryRegion.h"
+#include "../../Source/PluginProcessor.h"
+
+class EqDaemonServer
+{
+public:
+    struct Options
+    {
+        juce::String regionName{ EqDaemon::defaultRegionName };
+        int numSlots{ 32 };
+        int numWorkers{ 4 };
+    };
+
+    explicit EqDaemonServer(const Options& options);
+    ~EqDaemonServer();
+
+    bool start(juce::String& error);
+    void stop();
+
+    // Builds engines for newly claimed slots, applies state blobs the clients post and tears down closed or
+    // abandoned streams. Runs on the message thread.
+    void housekeep();
+
+    // One line per active stream with throughput and mean latency since the previous report, and the
+    // stream's maximum latency since it started.
+    juce::StringArray takeStatsReport(double elapsedSeconds);
+
+private:
+    struct StreamEngine
+    {
+        std::unique_ptr<EqPTAudioProcessor> processor;
+        juce::MidiBuffer midi;
+        uint32_t appliedStateSequence{ 0 };
+        std::array<uint8_t, EqDaemon::maxStateBytes> stateScratch;
+        std::atomic<bool> isInUse{ false };
+        uint64_t reportedBlocks{ 0 };
+        uint64_t reportedSamples{ 0 };
+        uint64_t reportedLatencyNs{ 0 };
+        // When the slot was first seen reserved without a client pid
+        std::optional<juce::uint32> unownedSinceMs;
+    };
+
+    static constexpr juce::uint32 unownedSlotTimeoutMs = 2000;
+
+    class Worker;
+
+    void admit(int slotIndex);
+    void retire(int slotIndex);
+    bool serviceSlot(int slotIndex);
+    void applyPendingState(StreamEngine& engine, EqDaemon::StreamSlot& slot);
+    static void resetStats(EqDaemon::StreamStats& stats);
+
+    Options m_Options;
+    SharedMemoryRegion m_Region;
+    EqDaemon::RegionHeader* m_Header{ nullptr };
+    EqDaemon::StreamSlot* m_Slots{ nullptr };
+    std::vector<std::unique_ptr<StreamEngine>> m_Engines;
+    juce::OwnedArray<Worker> m_Workers;
+
+    JUCE_DECLARE_NON_COPYABLE(EqDaemonServer)
+};
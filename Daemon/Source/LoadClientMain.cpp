@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+    Load-testing client for EqPTDaemon. Opens a number of streams, pushes
+    test tones through them as fast as the daemon accepts them (or paced in
+    real time) and reports throughput and round-trip latency. --automate
+    sweeps a parameter between two values, sending a few timestamped
+    changes with every block.
+
+    Usage: EqPTLoadClient [--name /eqpt-daemon] [--streams 8] [--channels 2]
+                          [--block 512] [--rate 48000] [--seconds 10]
+                          [--realtime] [--state saved-state.bin]
+                          [--automate "Mid Gain" -12 12] [--min-segment 32]
+
+  ==============================================================================
+*/
+
+#include "EqDaemonProtocol.h"
+#include "SharedMemoryRegion.h"
+#include "../../Source/ParameterKey.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace EqDaemon;
+
+namespace {
+    struct Options
+    {
+        std::string regionName{ defaultRegionName };
+        int numStreams{ 8 };
+        int numChannels{ 2 };
+        int blockSize{ 512 };
+        double sampleRate{ 48000.0 };
+        double seconds{ 10.0 };
+        bool isRealtime{ false };
+        std::vector<uint8_t> state;
+        std::string automatedParameter;
+        float automationMin{ 0.f };
+        float automationMax{ 0.f };
+        int minSegmentLength{ 0 };
+    };
+
+    constexpr int automationEventsPerBlock = 4;
+    constexpr double automationPeriodSeconds = 2.0;
+
+    struct StreamResult
+    {
+        bool isOk{ false };
+        uint64_t blocks{ 0 };
+        uint64_t samples{ 0 };
+        uint64_t totalLatencyNs{ 0 };
+        uint64_t maxLatencyNs{ 0 };
+        uint64_t totalProcessNs{ 0 };
+    };
+
+    StreamSlot* claimSlot(RegionHeader& header, int& index)
+    {
+        auto* slots = getSlots(&header);
+        for (uint32_t i = 0; i < header.numSlots; ++i) {
+            auto expected = static_cast<uint32_t>(Slot_Free);
+            if (slots[i].state.compare_exchange_strong(expected, Slot_Reserved)) {
+                index = static_cast<int>(i);
+                return &slots[i];
+            }
+        }
+        return nullptr;
+    }
+
+    StreamResult runStream(RegionHeader& header, const Options& options)
+    {
+        StreamResult result;
+        int index = 0;
+        auto* slot = claimSlot(header, index);
+        if (slot == nullptr) {
+            std::cerr << "No free stream slot" << std::endl;
+            return result;
+        }
+
+        slot->clientPid = static_cast<int32_t>(getpid());
+        slot->numChannels = static_cast<uint32_t>(options.numChannels);
+        slot->blockSize = static_cast<uint32_t>(options.blockSize);
+        slot->minSegmentLength = static_cast<uint32_t>(options.minSegmentLength);
+        slot->sampleRate = options.sampleRate;
+        slot->submitted.store(0, std::memory_order_relaxed);
+        slot->completed.store(0, std::memory_order_relaxed);
+        slot->stateSize = static_cast<uint32_t>(std::min<size_t>(options.state.size(), maxStateBytes));
+        std::memcpy(slot->stateData, options.state.data(), slot->stateSize);
+        // Sequence 0 means "nothing to apply"
+        slot->stateSequence.store(options.state.empty() ? 0u : 2u, std::memory_order_release);
+        slot->state.store(Slot_Claimed, std::memory_order_release);
+
+        while (slot->state.load(std::memory_order_acquire) == Slot_Claimed) {
+            Futex::wait(slot->state, Slot_Claimed, 100);
+        }
+        if (slot->state.load(std::memory_order_acquire) != Slot_Active) {
+            std::cerr << "Stream " << index << " was rejected" << std::endl;
+            return result;
+        }
+
+        auto& doorbell = header.workerDoorbells[static_cast<uint32_t>(index) % header.numWorkers].word;
+        const auto totalBlocks = static_cast<uint32_t>(options.seconds * options.sampleRate / options.blockSize);
+        const auto blockDuration = std::chrono::duration<double>(options.blockSize / options.sampleRate);
+        const auto phaseIncrement = 2.0 * 3.14159265358979 * (220.0 + 55.0 * index) / options.sampleRate;
+        const auto start = std::chrono::steady_clock::now();
+        double phase = 0.0;
+        uint32_t submitted = 0;
+        const auto automationKey = ParameterKey::fromID(options.automatedParameter.c_str());
+        const auto automationPeriod = automationPeriodSeconds * options.sampleRate;
+
+        for (; submitted < totalBlocks; ) {
+            // Wait for room in the ring
+            for (auto completed = slot->completed.load(std::memory_order_acquire);
+                 submitted - completed >= static_cast<uint32_t>(ringBlocks);
+                 completed = slot->completed.load(std::memory_order_acquire)) {
+                if (slot->state.load(std::memory_order_acquire) != Slot_Active) {
+                    std::cerr << "Stream " << index << " was closed by the daemon" << std::endl;
+                    return result;
+                }
+                Futex::wait(slot->completed, completed, 100);
+            }
+
+            const auto ringIndex = submitted % ringBlocks;
+            for (int n = 0; n < options.blockSize; ++n) {
+                const auto sample = static_cast<float>(0.25 * std::sin(phase));
+                phase += phaseIncrement;
+                for (int ch = 0; ch < options.numChannels; ++ch) {
+                    slot->audio[ringIndex][ch][n] = sample;
+                }
+            }
+            auto& block = slot->blocks[ringIndex];
+            block.numSamples = static_cast<uint32_t>(options.blockSize);
+            block.numEvents = 0;
+            if (!options.automatedParameter.empty()) {
+                // A triangle sweep, sampled at evenly spaced offsets within the block
+                for (int e = 0; e < automationEventsPerBlock; ++e) {
+                    const auto offset = e * options.blockSize / automationEventsPerBlock;
+                    const auto position = std::fmod(static_cast<double>(submitted) * options.blockSize + offset, automationPeriod) / automationPeriod;
+                    const auto triangle = static_cast<float>(1.0 - std::abs(2.0 * position - 1.0));
+                    block.events[block.numEvents++] = { automationKey, options.automationMin + triangle * (options.automationMax - options.automationMin), static_cast<uint32_t>(offset) };
+                }
+            }
+            block.submitTimeNs = Futex::nowNs();
+            slot->submitted.store(++submitted, std::memory_order_release);
+
+            doorbell.fetch_add(1, std::memory_order_release);
+            Futex::wake(doorbell, 1);
+
+            if (options.isRealtime) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockDuration * submitted));
+            }
+        }
+
+        for (auto completed = slot->completed.load(std::memory_order_acquire); completed != submitted;
+             completed = slot->completed.load(std::memory_order_acquire)) {
+            if (slot->state.load(std::memory_order_acquire) != Slot_Active) {
+                return result;
+            }
+            Futex::wait(slot->completed, completed, 100);
+        }
+
+        result.isOk = true;
+        result.blocks = slot->stats.blocksProcessed.load();
+        result.samples = slot->stats.samplesProcessed.load();
+        result.totalLatencyNs = slot->stats.totalLatencyNs.load();
+        result.maxLatencyNs = slot->stats.maxLatencyNs.load();
+        result.totalProcessNs = slot->stats.totalProcessNs.load();
+
+        slot->state.store(Slot_Closing, std::memory_order_release);
+        return result;
+    }
+
+    bool parseOptions(int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+
+            if (arg == "--name") options.regionName = next();
+            else if (arg == "--streams") options.numStreams = std::stoi(next());
+            else if (arg == "--channels") options.numChannels = std::stoi(next());
+            else if (arg == "--block") options.blockSize = std::stoi(next());
+            else if (arg == "--rate") options.sampleRate = std::stod(next());
+            else if (arg == "--seconds") options.seconds = std::stod(next());
+            else if (arg == "--realtime") options.isRealtime = true;
+            else if (arg == "--min-segment") options.minSegmentLength = std::stoi(next());
+            else if (arg == "--automate") {
+                options.automatedParameter = next();
+                options.automationMin = std::stof(next());
+                options.automationMax = std::stof(next());
+            }
+            else if (arg == "--state") {
+                std::ifstream file(next(), std::ios::binary);
+                options.state.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                if (options.state.size() > static_cast<size_t>(maxStateBytes)) {
+                    std::cerr << "State blob exceeds " << maxStateBytes << " bytes" << std::endl;
+                    return false;
+                }
+            }
+            else {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+        }
+        return options.numStreams > 0
+            && options.numChannels > 0 && options.numChannels <= maxChannelsPerStream
+            && options.blockSize > 0 && options.blockSize <= maxBlockSize
+            && options.minSegmentLength >= 0
+            && options.sampleRate > 0.0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            std::cerr << "Invalid arguments" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception&) {
+        std::cerr << "Invalid arguments" << std::endl;
+        return 1;
+    }
+
+    SharedMemoryRegion region;
+    if (!region.open(options.regionName)) {
+        std::cerr << "Could not open " << options.regionName << ": " << region.getLastError() << std::endl;
+        return 1;
+    }
+    auto& header = *static_cast<RegionHeader*>(region.getData());
+    if (region.getSize() < sizeof(RegionHeader) || header.magic != regionMagic || header.version != protocolVersion
+        || region.getSize() < getRegionSize(header.numSlots) || header.numWorkers == 0) {
+        std::cerr << options.regionName << " is not a compatible EqPT daemon region" << std::endl;
+        return 1;
+    }
+
+    std::vector<StreamResult> results(static_cast<size_t>(options.numStreams));
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.numStreams; ++i) {
+        threads.emplace_back([&, i] { results[static_cast<size_t>(i)] = runStream(header, options); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const auto wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    StreamResult total;
+    int numOk = 0;
+    for (const auto& result : results) {
+        if (!result.isOk) {
+            continue;
+        }
+        ++numOk;
+        total.blocks += result.blocks;
+        total.samples += result.samples;
+        total.totalLatencyNs += result.totalLatencyNs;
+        total.totalProcessNs += result.totalProcessNs;
+        total.maxLatencyNs = std::max(total.maxLatencyNs, result.maxLatencyNs);
+    }
+    if (numOk == 0 || total.blocks == 0) {
+        std::cerr << "No stream completed" << std::endl;
+        return 1;
+    }
+
+    const auto blocks = static_cast<double>(total.blocks);
+    std::cout << numOk << "/" << options.numStreams << " streams, " << total.blocks << " blocks in " << wallSeconds << " s\n"
+              << "throughput: " << static_cast<double>(total.samples) / wallSeconds / options.sampleRate << "x realtime (all streams), "
+              << blocks / wallSeconds << " blocks/s\n"
+              << "latency: mean " << static_cast<double>(total.totalLatencyNs) / blocks / 1000.0 << " us, max "
+              << static_cast<double>(total.maxLatencyNs) / 1000.0 << " us\n"
+              << "processing: mean " << static_cast<double>(total.totalProcessNs) / blocks / 1000.0 << " us per block" << std::endl;
+    return numOk == options.numStreams ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+  ==============================================================================
+
+    Headless EQ service. Clients attach through the shared memory region
+    described in EqDaemonProtocol.h; see LoadClientMain.cpp for an example.
+
+    Usage: EqPTDaemon [--name /eqpt-daemon] [--streams 32] [--workers N] [--stats-interval 5]
+           EqPTDaemon --bench-state[=instances]
+           EqPTDaemon --match <input> --reference <file> [--save-state <file>]
+           EqPTDaemon --bench-match[=runs]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "EqDaemonServer.h"
+#include "MatchTool.h"
+#include "StateLoadBenchmark.h"
+
+#include <csignal>
+#include <iostream>
+
+namespace {
+    std::atomic<bool> quitRequested{ false };
+
+    void handleQuitSignal(int)
+    {
+        quitRequested = true;
+    }
+}
+
+class EqDaemonApplication : public juce::JUCEApplication, private juce::Timer
+{
+public:
+    const juce::String getApplicationName() override { return "EqPTDaemon"; }
+    const juce::String getApplicationVersion() override { return ProjectInfo::versionString; }
+    bool moreThanOneInstanceAllowed() override { return true; }
+
+    void initialise(const juce::String&) override
+    {
+        const juce::ArgumentList args(getApplicationName(), getCommandLineParameterArray());
+
+        if (args.containsOption("--bench-state")) {
+            const auto numInstances = args.getValueForOption("--bench-state").getIntValue();
+            for (const auto& line : runStateLoadBenchmark(numInstances > 0 ? numInstances : 200)) {
+                std::cout << line << std::endl;
+            }
+            quit();
+            return;
+        }
+        if (args.containsOption("--match") || args.containsOption("--bench-match")) {
+            startMatchTool(args);
+            return;
+        }
+
+        EqDaemonServer::Options options;
+        if (args.containsOption("--name")) {
+            options.regionName = args.getValueForOption("--name");
+        }
+        if (args.containsOption("--streams")) {
+            options.numSlots = args.getValueForOption("--streams").getIntValue();
+        }
+        options.numWorkers = args.containsOption("--workers")
+            ? args.getValueForOption("--workers").getIntValue()
+            : juce::jmax(1, juce::SystemStats::getNumCpus() - 1);
+        if (args.containsOption("--stats-interval")) {
+            m_StatsInterval = args.getValueForOption("--stats-interval").getDoubleValue();
+        }
+
+        m_Server = std::make_unique<EqDaemonServer>(options);
+        juce::String error;
+        if (!m_Server->start(error)) {
+            std::cerr << "Could not create " << options.regionName << ": " << error << std::endl;
+            m_Server.reset();
+            setApplicationReturnValue(1);
+            quit();
+            return;
+        }
+
+        std::signal(SIGINT, handleQuitSignal);
+        std::signal(SIGTERM, handleQuitSignal);
+
+        std::cout << "Serving " << options.regionName << " with " << options.numSlots << " stream slots on "
+                  << options.numWorkers << " workers" << std::endl;
+        m_LastReport = juce::Time::getMillisecondCounterHiRes();
+        startTimer(20);
+    }
+
+    void shutdown() override
+    {
+        stopTimer();
+        m_MatchTool.reset();
+        m_Server.reset();
+    }
+
+    void anotherInstanceStarted(const juce::String&) override {}
+
+private:
+    void startMatchTool(const juce::ArgumentList& args)
+    {
+        const auto cwd = juce::File::getCurrentWorkingDirectory();
+        MatchTool::Options options;
+        if (args.containsOption("--bench-match")) {
+            // Generated files with a known curve, so every run does the same work
+            const auto tempDirectory = juce::File::getSpecialLocation(juce::File::tempDirectory);
+            options.input = tempDirectory.getChildFile("eqpt-match-input.wav");
+            options.reference = tempDirectory.getChildFile("eqpt-match-reference.wav");
+            const auto numRuns = args.getValueForOption("--bench-match").getIntValue();
+            options.numRuns = numRuns > 0 ? numRuns : 10;
+            if (!MatchTool::createBenchmarkFiles(options.input, options.reference)) {
+                std::cerr << "Could not write the benchmark files to " << tempDirectory.getFullPathName() << std::endl;
+                setApplicationReturnValue(1);
+                quit();
+                return;
+            }
+        } else {
+            options.input = cwd.getChildFile(args.getValueForOption("--match"));
+            options.reference = cwd.getChildFile(args.getValueForOption("--reference"));
+            if (args.containsOption("--save-state")) {
+                options.stateOutput = cwd.getChildFile(args.getValueForOption("--save-state"));
+            }
+        }
+
+        m_MatchTool = std::make_unique<MatchTool>(options);
+        m_MatchTool->onFinished = [this](int exitCode) {
+            setApplicationReturnValue(exitCode);
+            quit();
+        };
+        m_MatchTool->start();
+    }
+
+    void timerCallback() override
+    {
+        if (quitRequested) {
+            quit();
+            return;
+        }
+
+        m_Server->housekeep();
+
+        const auto now = juce::Time::getMillisecondCounterHiRes();
+        const auto elapsedSeconds = (now - m_LastReport) / 1000.0;
+        if (m_StatsInterval > 0.0 && elapsedSeconds >= m_StatsInterval) {
+            for (const auto& line : m_Server->takeStatsReport(elapsedSeconds)) {
+                std::cout << line << std::endl;
+            }
+            m_LastReport = now;
+        }
+    }
+
+    std::unique_ptr<EqDaemonServer> m_Server;
+    std::unique_ptr<MatchTool> m_MatchTool;
+    double m_StatsInterval{ 5.0 };
+    double m_LastReport{ 0.0 };
+};
+
+START_JUCE_APPLICATION(EqDaemonApplication)
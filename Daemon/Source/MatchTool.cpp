@@ -0,0 +1,210 @@
+/*
+  ==============================================================================
+
+    Command-line front end to the EQ matcher.
+
+  ==============================================================================
+*/
+
+#include "MatchTool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+MatchTool::MatchTool(const Options& options)
+    : m_Options(options)
+{
+    m_Options.numRuns = juce::jmax(1, m_Options.numRuns);
+}
+
+MatchTool::~MatchTool()
+{
+    stopTimer();
+}
+
+void MatchTool::start()
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    m_InputReader.reset(formats.createReaderFor(m_Options.input));
+    if (m_InputReader == nullptr || m_InputReader->numChannels == 0) {
+        std::cerr << "Could not read " << m_Options.input.getFullPathName() << std::endl;
+        finish(1);
+        return;
+    }
+    if (!m_Options.reference.existsAsFile()) {
+        std::cerr << m_Options.reference.getFullPathName() << " does not exist" << std::endl;
+        finish(1);
+        return;
+    }
+
+    // The matcher mixes its input down, so the first two channels are plenty
+    const auto numChannels = juce::jmin(2, static_cast<int>(m_InputReader->numChannels));
+    const auto sampleRate = m_InputReader->sampleRate;
+    m_Buffer.setSize(numChannels, blockSize);
+    m_SamplesToCapture = juce::jmin(m_InputReader->lengthInSamples, static_cast<juce::int64>(maxCaptureSeconds * sampleRate));
+
+    m_Processor = std::make_unique<EqPTAudioProcessor>();
+    m_Processor->setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+    m_Processor->prepareToPlay(sampleRate, blockSize);
+    m_Processor->onMatchApplied = [this](const EqMatcher::Result& result) { matchApplied(result); };
+    m_Processor->getMatcher().startInputCapture();
+
+    m_Phase = Phase::Capturing;
+    startTimer(10);
+}
+
+void MatchTool::timerCallback()
+{
+    if (m_Phase == Phase::Capturing) {
+        capture();
+        return;
+    }
+    if (m_Phase != Phase::Matching) {
+        return;
+    }
+
+    // A failed match leaves an error instead of delivering a result
+    auto& matcher = m_Processor->getMatcher();
+    if (!matcher.isMatching()) {
+        const auto error = matcher.getLastError();
+        if (error.isNotEmpty()) {
+            std::cerr << error << std::endl;
+            finish(1);
+        }
+    }
+}
+
+void MatchTool::capture()
+{
+    // Played through the processor as a host would, so the capture sees exactly what the plugin gets
+    const auto numSamples = static_cast<int>(juce::jmin<juce::int64>(samplesPerTick, m_SamplesToCapture - m_CapturedSamples));
+    juce::MidiBuffer midi;
+    for (int offset = 0; offset < numSamples; offset += blockSize) {
+        const auto blockLength = juce::jmin(blockSize, numSamples - offset);
+        m_InputReader->read(&m_Buffer, 0, blockLength, m_CapturedSamples + offset, true, true);
+        juce::AudioBuffer<float> block(m_Buffer.getArrayOfWritePointers(), m_Buffer.getNumChannels(), blockLength);
+        m_Processor->processBlock(block, midi);
+    }
+    m_CapturedSamples += numSamples;
+    if (m_CapturedSamples < m_SamplesToCapture) {
+        return;
+    }
+
+    auto& matcher = m_Processor->getMatcher();
+    matcher.stopInputCapture();
+    matcher.setReferenceFile(m_Options.reference);
+    matcher.startMatch();
+    m_Phase = Phase::Matching;
+}
+
+void MatchTool::matchApplied(const EqMatcher::Result& result)
+{
+    using namespace Params;
+
+    m_FitMilliseconds.push_back(result.fitMilliseconds);
+    if (static_cast<int>(m_FitMilliseconds.size()) < m_Options.numRuns) {
+        // The captured spectra are kept, so every run fits the same target
+        m_Processor->getMatcher().startMatch();
+        return;
+    }
+
+    for (int band = 0; band < numLegacyBands; ++band) {
+        const auto type = legacyBandTypes[static_cast<size_t>(band)];
+        const auto isCut = type == Band_LowCut || type == Band_HighCut;
+        juce::String line = "Band " + juce::String(band + 1) + " (" + m_Processor->m_TreeState.getParameter(ParameterNames[bandParameter(band, Field_Type)])->getCurrentValueAsText() + "):";
+        for (auto field : isCut ? std::vector<BandField>{ Field_Freq, Field_Slope } : std::vector<BandField>{ Field_Freq, Field_Gain, Field_Q }) {
+            line << " " << bandFieldNames[field] << " " << m_Processor->m_TreeState.getParameter(ParameterNames[bandParameter(band, field)])->getCurrentValueAsText();
+        }
+        std::cout << line << std::endl;
+    }
+    std::cout << "remaining error " << juce::String(result.rmsErrorDb, 2) << " dB rms" << std::endl;
+
+    const auto fastest = *std::min_element(m_FitMilliseconds.begin(), m_FitMilliseconds.end());
+    const auto slowest = *std::max_element(m_FitMilliseconds.begin(), m_FitMilliseconds.end());
+    const auto mean = std::accumulate(m_FitMilliseconds.begin(), m_FitMilliseconds.end(), 0.0) / static_cast<double>(m_FitMilliseconds.size());
+    std::cout << "fit: " << juce::String(mean, 1) << " ms mean, " << juce::String(fastest, 1) << " ms min, " << juce::String(slowest, 1)
+              << " ms max over " << m_FitMilliseconds.size() << " runs on " << juce::SystemStats::getNumCpus() << " cpus" << std::endl;
+
+    if (m_Options.stateOutput != juce::File()) {
+        juce::MemoryBlock state;
+        m_Processor->getStateInformation(state);
+        if (!m_Options.stateOutput.replaceWithData(state.getData(), state.getSize())) {
+            std::cerr << "Could not write " << m_Options.stateOutput.getFullPathName() << std::endl;
+            finish(1);
+            return;
+        }
+    }
+    finish(0);
+}
+
+void MatchTool::finish(int exitCode)
+{
+    stopTimer();
+    m_Phase = Phase::Done;
+    if (onFinished != nullptr) {
+        onFinished(exitCode);
+    }
+}
+
+bool MatchTool::createBenchmarkFiles(const juce::File& input, const juce::File& reference)
+{
+    using namespace Params;
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2;
+    constexpr int lengthInSamples = 20 * 48000;
+
+    // The reference is the input through a low shelf lift, a mid cut and a high shelf lift
+    EqPTAudioProcessor shaper;
+    shaper.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+    shaper.prepareToPlay(sampleRate, blockSize);
+    auto setParameter = [&shaper](Parameters p, float value) {
+        auto* parameter = shaper.m_TreeState.getParameter(ParameterNames[p]);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    };
+    setParameter(bandParameter(1, Field_Freq), 150.f);
+    setParameter(bandParameter(1, Field_Gain), 4.f);
+    setParameter(bandParameter(3, Field_Freq), 1000.f);
+    setParameter(bandParameter(3, Field_Gain), -3.f);
+    setParameter(bandParameter(3, Field_Q), 1.5f);
+    setParameter(bandParameter(5, Field_Freq), 8000.f);
+    setParameter(bandParameter(5, Field_Gain), 2.f);
+
+    juce::WavAudioFormat wav;
+    auto createWriter = [&wav](const juce::File& file) {
+        file.deleteFile();
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream->openedOk()) {
+            writer.reset(wav.createWriterFor(stream.get(), sampleRate, numChannels, 24, {}, 0));
+        }
+        if (writer != nullptr) {
+            // The writer owns the stream from here on
+            stream.release();
+        }
+        return writer;
+    };
+    auto inputWriter = createWriter(input);
+    auto referenceWriter = createWriter(reference);
+    if (inputWriter == nullptr || referenceWriter == nullptr) {
+        return false;
+    }
+
+    juce::Random random(42);
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midi;
+    for (int position = 0; position < lengthInSamples; position += blockSize) {
+        for (int ch = 0; ch < numChannels; ++ch) {
+            auto* samples = buffer.getWritePointer(ch);
+            for (int i = 0; i < blockSize; ++i) {
+                samples[i] = 0.25f * (2.f * random.nextFloat() - 1.f);
+            }
+        }
+        inputWriter->writeFromAudioSampleBuffer(buffer, 0, blockSize);
+        shaper.processBlock(buffer, midi);
+        referenceWriter->writeFromAudioSampleBuffer(buffer, 0, blockSize);
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    Command-line front end to the EQ matcher. Plays an input file through a
+    processor while the matcher captures it, matches it to a reference file
+    and reports the fitted bands. The benchmark does the same with generated
+    files and times the fit over several runs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+class MatchTool : private juce::Timer
+{
+public:
+    struct Options
+    {
+        juce::File input;
+        juce::File reference;
+        // Where the matched processor state goes, if anywhere
+        juce::File stateOutput;
+        int numRuns{ 1 };
+    };
+
+    explicit MatchTool(const Options& options);
+    ~MatchTool() override;
+
+    // Runs on the message thread, which is where matches are delivered. Reports go to stdout and
+    // onFinished is called once with the exit code.
+    void start();
+    std::function<void(int exitCode)> onFinished;
+
+    // Writes a noise input and a reference made from it through a known curve, for the benchmark
+    static bool createBenchmarkFiles(const juce::File& input, const juce::File& reference);
+
+private:
+    enum class Phase
+    {
+        Capturing,
+        Matching,
+        Done,
+    };
+
+    void timerCallback() override;
+    void capture();
+    void matchApplied(const EqMatcher::Result& result);
+    void finish(int exitCode);
+
+    static constexpr int blockSize = 512;
+    // Input fed per timer tick; the matcher drains its capture FIFO at a similar rate
+    static constexpr int samplesPerTick = 8192;
+    // The averaged spectrum settles long before this
+    static constexpr double maxCaptureSeconds = 60.0;
+
+    Options m_Options;
+    Phase m_Phase{ Phase::Capturing };
+    std::unique_ptr<EqPTAudioProcessor> m_Processor;
+    std::unique_ptr<juce::AudioFormatReader> m_InputReader;
+    juce::AudioBuffer<float> m_Buffer;
+    juce::int64 m_CapturedSamples{ 0 };
+    juce::int64 m_SamplesToCapture{ 0 };
+    std::vector<double> m_FitMilliseconds;
+
+    JUCE_DECLARE_NON_COPYABLE(MatchTool)
+};
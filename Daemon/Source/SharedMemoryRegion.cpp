@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    POSIX shared memory mapping plus the futex calls used to signal across it.
+
+  ==============================================================================
+*/
+
+#include "SharedMemoryRegion.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+SharedMemoryRegion::~SharedMemoryRegion()
+{
+    close();
+}
+
+bool SharedMemoryRegion::create(const std::string& name, size_t size)
+{
+    close();
+    shm_unlink(name.c_str());
+
+    const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        m_LastError = "shm_open failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        m_LastError = "ftruncate failed: " + std::string(std::strerror(errno));
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    if (!map(fd, size)) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    m_Name = name;
+    m_IsOwner = true;
+    return true;
+}
+
+bool SharedMemoryRegion::open(const std::string& name)
+{
+    close();
+
+    const auto fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        m_LastError = "shm_open failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        m_LastError = "fstat failed: " + std::string(std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (!map(fd, static_cast<size_t>(info.st_size))) {
+        return false;
+    }
+    m_Name = name;
+    m_IsOwner = false;
+    return true;
+}
+
+void SharedMemoryRegion::close()
+{
+    if (m_Data != nullptr) {
+        munmap(m_Data, m_Size);
+    }
+    if (m_IsOwner) {
+        shm_unlink(m_Name.c_str());
+    }
+    m_Data = nullptr;
+    m_Size = 0;
+    m_IsOwner = false;
+    m_Name.clear();
+}
+
+bool SharedMemoryRegion::map(int fd, size_t size)
+{
+    auto* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        m_LastError = "mmap failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    m_Data = data;
+    m_Size = size;
+    return true;
+}
+
+namespace Futex {
+    // The words live in memory shared between processes, so the non-private futex operations are required.
+    void wait(EqDaemon::FutexWord& word, uint32_t expected, int timeoutMs)
+    {
+        timespec timeout{ timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, timeoutMs >= 0 ? &timeout : nullptr, nullptr, 0);
+    }
+
+    void wake(EqDaemon::FutexWord& word, int numWaiters)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, numWaiters, nullptr, nullptr, 0);
+    }
+
+    uint64_t nowNs()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+    }
+}
@@ -0,0 +1,50 @@
+/*
+  ==============================================================================
+
+    POSIX shared memory mapping plus the futex calls used to signal across it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "EqDaemonProtocol.h"
+
+#include <string>
+
+class SharedMemoryRegion
+{
+public:
+    SharedMemoryRegion() = default;
+    ~SharedMemoryRegion();
+
+    // Creates (replacing any stale region of the same name) and maps a zeroed region. The creator unlinks it on destruction.
+    bool create(const std::string& name, size_t size);
+    // Maps an existing region, sized from what the creator truncated it to.
+    bool open(const std::string& name);
+    void close();
+
+    void* getData() const { return m_Data; }
+    size_t getSize() const { return m_Size; }
+    const std::string& getLastError() const { return m_LastError; }
+
+private:
+    bool map(int fd, size_t size);
+
+    std::string m_Name;
+    std::string m_LastError;
+    void* m_Data{ nullptr };
+    size_t m_Size{ 0 };
+    bool m_IsOwner{ false };
+
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+    SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+};
+
+namespace Futex {
+    // Sleeps while word == expected, for at most timeoutMs (negative waits forever). Spurious wake-ups are possible.
+    void wait(EqDaemon::FutexWord& word, uint32_t expected, int timeoutMs);
+    void wake(EqDaemon::FutexWord& word, int numWaiters);
+
+    uint64_t nowNs();
+}
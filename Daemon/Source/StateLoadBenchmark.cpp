@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    Times loading one session into many processors, comparing the tree
+    state path (replaceState) with the compact binary state layout.
+
+  ==============================================================================
+*/
+
+#include "StateLoadBenchmark.h"
+#include "../../Source/PluginProcessor.h"
+
+namespace {
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    constexpr int numRounds = 5;
+
+    std::unique_ptr<EqPTAudioProcessor> createProcessor()
+    {
+        auto processor = std::make_unique<EqPTAudioProcessor>();
+        processor->setPlayConfigDetails(2, 2, sampleRate, blockSize);
+        processor->prepareToPlay(sampleRate, blockSize);
+        return processor;
+    }
+
+    // Every parameter moved away from its default, as in a worked-on session
+    juce::MemoryBlock createSessionState(EqPTAudioProcessor& processor)
+    {
+        juce::Random random(42);
+        for (auto* parameter : processor.getParameters()) {
+            parameter->setValueNotifyingHost(random.nextFloat());
+        }
+        juce::MemoryBlock state;
+        processor.getStateInformation(state);
+        return state;
+    }
+
+    juce::MemoryBlock createTreeState(EqPTAudioProcessor& processor)
+    {
+        juce::MemoryBlock state;
+        juce::MemoryOutputStream mos(state, false);
+        processor.m_TreeState.copyState().writeToStream(mos);
+        return state;
+    }
+}
+
+juce::StringArray runStateLoadBenchmark(int numInstances)
+{
+    numInstances = juce::jmax(1, numInstances);
+
+    std::vector<std::unique_ptr<EqPTAudioProcessor>> processors;
+    for (int i = 0; i < numInstances; ++i) {
+        processors.push_back(createProcessor());
+    }
+
+    juce::MemoryBlock defaultState;
+    processors.front()->getStateInformation(defaultState);
+    auto source = createProcessor();
+    const auto binaryState = createSessionState(*source);
+    const auto treeState = createTreeState(*source);
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+
+    // Each round starts from defaults, so every load really changes every parameter
+    auto time = [&](const std::function<void(EqPTAudioProcessor&)>& load) {
+        auto best = std::numeric_limits<double>::max();
+        for (int round = 0; round < numRounds; ++round) {
+            for (auto& processor : processors) {
+                processor->setStateInformation(defaultState.getData(), static_cast<int>(defaultState.getSize()));
+                buffer.clear();
+                processor->processBlock(buffer, midi);
+            }
+
+            const auto start = juce::Time::getMillisecondCounterHiRes();
+            for (auto& processor : processors) {
+                load(*processor);
+                buffer.clear();
+                processor->processBlock(buffer, midi);
+            }
+            best = juce::jmin(best, juce::Time::getMillisecondCounterHiRes() - start);
+        }
+        return best;
+    };
+
+    const auto treeMs = time([&treeState](EqPTAudioProcessor& processor) {
+        processor.m_TreeState.replaceState(juce::ValueTree::readFromData(treeState.getData(), treeState.getSize()));
+    });
+    const auto legacyMs = time([&treeState](EqPTAudioProcessor& processor) {
+        processor.setStateInformation(treeState.getData(), static_cast<int>(treeState.getSize()));
+    });
+    const auto binaryMs = time([&binaryState](EqPTAudioProcessor& processor) {
+        processor.setStateInformation(binaryState.getData(), static_cast<int>(binaryState.getSize()));
+    });
+
+    auto describe = [numInstances](const juce::String& name, double ms, size_t bytes) {
+        return name + ": " + juce::String(ms, 2) + " ms for " + juce::String(numInstances) + " instances ("
+            + juce::String(1000.0 * ms / numInstances, 1) + " us each, " + juce::String(static_cast<int>(bytes)) + " byte state)";
+    };
+    juce::StringArray lines;
+    lines.add(describe("replaceState, tree blob    ", treeMs, treeState.getSize()));
+    lines.add(describe("setState, legacy tree blob ", legacyMs, treeState.getSize()));
+    lines.add(describe("setState, binary blob      ", binaryMs, binaryState.getSize()));
+    return lines;
+}
@@ -0,0 +1,15 @@
+/*
+  ==============================================================================
+
+    Times loading one session into many processors, comparing the tree
+    state path (replaceState) with the compact binary state layout.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// One report line per load path. Each timing covers the state load and the first block, which does the redesign.
+juce::StringArray runStateLoadBenchmark(int numInstances);
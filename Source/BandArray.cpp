@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    Coefficients and filter state for a runtime-sized set of bands.
+
+  ==============================================================================
+*/
+
+#include "BandArray.h"
+
+void BandArray::prepare(double sampleRate, int numChannels)
+{
+    m_SampleRate = sampleRate;
+    m_NumChannels = juce::jmax(1, numChannels);
+    m_RampLength = juce::jmax(1, juce::roundToInt(sampleRate * SvfFilter::rampTimeSeconds));
+    m_States.assign(static_cast<size_t>(m_NumChannels * maxStages), StageState{});
+    reset();
+}
+
+void BandArray::reset()
+{
+    for (auto& state : m_States) {
+        state.z1 = 0.f;
+        state.z2 = 0.f;
+        state.svf.reset();
+        // Forces the next design onto the SVF, which jumps straight to it after a reset
+        state.version = 0;
+    }
+}
+
+void BandArray::setTopology(FilterTopology topology)
+{
+    if (topology != m_Topology) {
+        m_Topology = topology;
+        reset();
+    }
+}
+
+void BandArray::designBand(int set, int band, const BandSettings& settings)
+{
+    const auto isCut = settings.type == Band_LowCut || settings.type == Band_HighCut;
+    const auto numStages = settings.isBypassed ? 0 : isCut ? 1 + static_cast<int>(settings.slope) : 1;
+    m_NumBandStages[static_cast<size_t>(set)][static_cast<size_t>(band)] = numStages;
+    if (numStages == 0) {
+        return;
+    }
+
+    // Only the active topology is designed, so an SVF update stays at one tan and a few multiplies
+    BiquadCoefficients biquad;
+    SvfCoefficients svf;
+    if (m_Topology == Topology_SVF) {
+        svf = designSvf(settings);
+    }
+    else {
+        biquad = designBiquad(settings);
+    }
+
+    for (int s = 0; s < numStages; ++s) {
+        const auto slot = band * maxStagesPerBand + s;
+        auto& design = m_Designs[static_cast<size_t>(set)][static_cast<size_t>(slot)];
+        design.biquad = biquad;
+        design.svf = svf;
+        design.slot = slot;
+        design.version = ++m_NextVersion;
+    }
+}
+
+BandArray::BiquadCoefficients BandArray::designBiquad(const BandSettings& settings) const
+{
+    using ArrayCoefficients = juce::dsp::IIR::ArrayCoefficients<float>;
+
+    // The biquad designs have no prewarp clamp of their own
+    const auto freq = juce::jmin(settings.freq, static_cast<float>(0.49 * m_SampleRate));
+    const auto gainFactor = juce::Decibels::decibelsToGain(settings.gain);
+    std::array<float, 6> c{ 1.f, 0.f, 0.f, 1.f, 0.f, 0.f };
+
+    switch (settings.type) {
+    case Band_Peak: c = ArrayCoefficients::makePeakFilter(m_SampleRate, freq, settings.q, gainFactor); break;
+    case Band_LowShelf: c = ArrayCoefficients::makeLowShelf(m_SampleRate, freq, settings.q, gainFactor); break;
+    case Band_HighShelf: c = ArrayCoefficients::makeHighShelf(m_SampleRate, freq, settings.q, gainFactor); break;
+    case Band_LowCut: c = ArrayCoefficients::makeHighPass(m_SampleRate, freq); break;
+    case Band_HighCut: c = ArrayCoefficients::makeLowPass(m_SampleRate, freq); break;
+    case Band_Notch: c = ArrayCoefficients::makeNotch(m_SampleRate, freq, settings.q); break;
+    case Band_Tilt: {
+        // Same shape as the SVF tilt: a low shelf cutting by the full gain, lifted by half of it
+        c = ArrayCoefficients::makeLowShelf(m_SampleRate, freq, settings.q, 1.f / gainFactor);
+        const auto lift = std::sqrt(gainFactor);
+        c[0] *= lift;
+        c[1] *= lift;
+        c[2] *= lift;
+        break;
+    }
+    default: jassertfalse;
+    }
+    return { c[0] / c[3], c[1] / c[3], c[2] / c[3], c[4] / c[3], c[5] / c[3] };
+}
+
+SvfCoefficients BandArray::designSvf(const BandSettings& settings) const
+{
+    const auto gainFactor = juce::Decibels::decibelsToGain(settings.gain);
+
+    switch (settings.type) {
+    case Band_Peak: return SvfCoefficients::makePeakFilter(m_SampleRate, settings.freq, settings.q, gainFactor);
+    case Band_LowShelf: return SvfCoefficients::makeLowShelf(m_SampleRate, settings.freq, settings.q, gainFactor);
+    case Band_HighShelf: return SvfCoefficients::makeHighShelf(m_SampleRate, settings.freq, settings.q, gainFactor);
+    case Band_LowCut: return SvfCoefficients::makeHighPass(m_SampleRate, settings.freq);
+    case Band_HighCut: return SvfCoefficients::makeLowPass(m_SampleRate, settings.freq);
+    case Band_Notch: return SvfCoefficients::makeNotch(m_SampleRate, settings.freq, settings.q);
+    case Band_Tilt: return SvfCoefficients::makeTilt(m_SampleRate, settings.freq, settings.q, gainFactor);
+    default: jassertfalse;
+    }
+    return {};
+}
+
+void BandArray::updateActiveStages(int set, int numBands)
+{
+    const auto& designs = m_Designs[static_cast<size_t>(set)];
+    auto& active = m_ActiveStages[static_cast<size_t>(set)];
+    int count = 0;
+    for (int band = 0; band < juce::jmin(numBands, maxBands); ++band) {
+        const auto numStages = m_NumBandStages[static_cast<size_t>(set)][static_cast<size_t>(band)];
+        for (int s = 0; s < numStages; ++s) {
+            active[static_cast<size_t>(count++)] = designs[static_cast<size_t>(band * maxStagesPerBand + s)];
+        }
+    }
+    m_NumActiveStages[static_cast<size_t>(set)] = count;
+}
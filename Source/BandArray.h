@@ -0,0 +1,184 @@
+/*
+  ==============================================================================
+
+    Coefficients and filter state for a runtime-sized set of bands.
+
+    Every band owns up to three filter stages (cuts cascade one per 12 dB of
+    slope). Stage designs and per-channel state live in flat arrays that are
+    allocated up front; the stages of the active bands are packed into one
+    list per design set, so the per-sample cost follows the number of active
+    bands rather than the maximum.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SvfFilter.h"
+
+enum CutSlope {
+    Slope_12 = 0,
+    Slope_24,
+    Slope_36,
+};
+
+
+enum FilterTopology {
+    Topology_Biquad = 0,
+    Topology_SVF,
+};
+
+
+enum BandType {
+    Band_Peak = 0,
+    Band_LowShelf,
+    Band_HighShelf,
+    Band_LowCut,
+    Band_HighCut,
+    Band_Notch,
+    Band_Tilt,
+};
+
+// What one band is set to. Gain is in dB; a tilt splits it evenly between cutting the lows and lifting the highs.
+struct BandSettings
+{
+    BandType type{ Band_Peak };
+    float freq{ 1000.f };
+    float gain{ 0.f };
+    float q{ 1.f };
+    CutSlope slope{ Slope_24 };
+    bool isBypassed{ false };
+};
+
+class BandArray
+{
+public:
+    static constexpr int maxBands = 24;
+    static constexpr int maxStagesPerBand = 3;
+    static constexpr int maxStages = maxBands * maxStagesPerBand;
+    static constexpr int numDesignSets = 2;
+
+    // Allocates the state of every channel; nothing is allocated after this
+    void prepare(double sampleRate, int numChannels);
+    void reset();
+    // Switching starts every channel of the new topology from silence. Designs are per topology, so every
+    // band in use has to be designed again afterwards.
+    void setTopology(FilterTopology topology);
+
+    // Designs a band's stages in the given set for the current topology. Takes effect once the set's active
+    // stages are rebuilt.
+    void designBand(int set, int band, const BandSettings& settings);
+    // Packs the stages of the first numBands bands that are not bypassed, in band order
+    void updateActiveStages(int set, int numBands);
+
+    // Runs a channel through the active stages of a set. input(i) supplies the i-th sample and may read
+    // from output, which the first stage writes in place; gain is applied on the last stage's write.
+    template <typename Input>
+    void process(int set, int channel, Input input, float* output, int numSamples, float gain) noexcept;
+
+private:
+    // Transposed direct form II, normalised by a0
+    struct BiquadCoefficients
+    {
+        float b0{ 1.f }, b1{ 0.f }, b2{ 0.f }, a1{ 0.f }, a2{ 0.f };
+    };
+
+    // Only the active topology's coefficients are set
+    struct StageDesign
+    {
+        BiquadCoefficients biquad;
+        SvfCoefficients svf;
+        // Where the stage's state sits within a channel, and a stamp that changes with every redesign
+        int slot{ 0 };
+        juce::uint32 version{ 0 };
+    };
+
+    // The SVF ramps towards new designs per channel, so it keeps its own copy of the coefficients
+    struct StageState
+    {
+        float z1{ 0.f }, z2{ 0.f };
+        SvfFilter svf;
+        juce::uint32 version{ 0 };
+    };
+
+    BiquadCoefficients designBiquad(const BandSettings& settings) const;
+    SvfCoefficients designSvf(const BandSettings& settings) const;
+
+    template <typename Input>
+    static void processBiquad(const BiquadCoefficients& c, StageState& state, Input& input, float* output, int numSamples, float gain) noexcept;
+
+    double m_SampleRate{ 44100.0 };
+    int m_NumChannels{ 0 };
+    int m_RampLength{ 1 };
+    FilterTopology m_Topology{ Topology_Biquad };
+    juce::uint32 m_NextVersion{ 0 };
+
+    // Designs by slot, and the stages of the active bands packed in processing order
+    std::array<std::array<StageDesign, maxStages>, numDesignSets> m_Designs;
+    std::array<std::array<int, maxBands>, numDesignSets> m_NumBandStages{};
+    std::array<std::array<StageDesign, maxStages>, numDesignSets> m_ActiveStages;
+    std::array<int, numDesignSets> m_NumActiveStages{};
+    // maxStages slots per channel
+    std::vector<StageState> m_States;
+};
+
+template <typename Input>
+void BandArray::processBiquad(const BiquadCoefficients& c, StageState& state, Input& input, float* output, int numSamples, float gain) noexcept
+{
+    auto z1 = state.z1;
+    auto z2 = state.z2;
+    for (int i = 0; i < numSamples; ++i) {
+        const auto x = input(i);
+        const auto y = c.b0 * x + z1;
+        z1 = c.b1 * x - c.a1 * y + z2;
+        z2 = c.b2 * x - c.a2 * y;
+        output[i] = gain * y;
+    }
+    juce::dsp::util::snapToZero(z1);
+    juce::dsp::util::snapToZero(z2);
+    state.z1 = z1;
+    state.z2 = z2;
+}
+
+template <typename Input>
+void BandArray::process(int set, int channel, Input input, float* output, int numSamples, float gain) noexcept
+{
+    jassert(channel < m_NumChannels);
+    const auto numStages = m_NumActiveStages[static_cast<size_t>(set)];
+    if (numStages == 0) {
+        for (int i = 0; i < numSamples; ++i) {
+            output[i] = gain * input(i);
+        }
+        return;
+    }
+
+    auto* states = m_States.data() + channel * maxStages;
+    auto readOutput = [output](int i) { return output[i]; };
+    const auto& stages = m_ActiveStages[static_cast<size_t>(set)];
+
+    for (int k = 0; k < numStages; ++k) {
+        const auto& design = stages[static_cast<size_t>(k)];
+        auto& state = states[design.slot];
+        const auto stageGain = k == numStages - 1 ? gain : 1.f;
+
+        if (m_Topology == Topology_SVF) {
+            if (state.version != design.version) {
+                state.svf.setCoefficients(design.svf, m_RampLength);
+                state.version = design.version;
+            }
+            if (k == 0) {
+                state.svf.process(input, output, numSamples, stageGain);
+            }
+            else {
+                state.svf.process(readOutput, output, numSamples, stageGain);
+            }
+        }
+        else if (k == 0) {
+            processBiquad(design.biquad, state, input, output, numSamples, stageGain);
+        }
+        else {
+            processBiquad(design.biquad, state, readOutput, output, numSamples, stageGain);
+        }
+    }
+}
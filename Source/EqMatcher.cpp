@@ -0,0 +1,512 @@
+/*
+  ==============================================================================
+
+    Matches the tonal balance of the plugin input to a reference file.
+
+  ==============================================================================
+*/
+
+#include "EqMatcher.h"
+
+EqMatcher::AveragedSpectrum::AveragedSpectrum()
+    : m_Frame(fftSize), m_FftData(2 * fftSize), m_PowerSum(fftSize / 2 + 1)
+{
+}
+
+void EqMatcher::AveragedSpectrum::reset(double sampleRate)
+{
+    m_SampleRate = sampleRate;
+    std::fill(m_PowerSum.begin(), m_PowerSum.end(), 0.0);
+    m_FrameFill = 0;
+    m_NumFrames = 0;
+}
+
+void EqMatcher::AveragedSpectrum::addSamples(const float* samples, int numSamples)
+{
+    while (numSamples > 0) {
+        const auto numToCopy = juce::jmin(numSamples, fftSize - m_FrameFill);
+        std::copy(samples, samples + numToCopy, m_Frame.begin() + m_FrameFill);
+        m_FrameFill += numToCopy;
+        samples += numToCopy;
+        numSamples -= numToCopy;
+        if (m_FrameFill < fftSize) {
+            return;
+        }
+
+        std::copy(m_Frame.begin(), m_Frame.end(), m_FftData.begin());
+        m_Window.multiplyWithWindowingTable(m_FftData.data(), static_cast<size_t>(fftSize));
+        m_Fft.performFrequencyOnlyForwardTransform(m_FftData.data(), true);
+        for (size_t bin = 0; bin < m_PowerSum.size(); ++bin) {
+            m_PowerSum[bin] += static_cast<double>(m_FftData[bin]) * m_FftData[bin];
+        }
+        ++m_NumFrames;
+
+        // The second half starts the next frame
+        std::copy(m_Frame.begin() + fftSize / 2, m_Frame.end(), m_Frame.begin());
+        m_FrameFill = fftSize / 2;
+    }
+}
+
+float EqMatcher::AveragedSpectrum::getLevelDb(double frequency) const
+{
+    if (m_NumFrames == 0) {
+        return -200.f;
+    }
+    const auto binWidth = m_SampleRate / fftSize;
+    const auto lastBin = fftSize / 2;
+    const auto first = juce::jlimit(1, lastBin, juce::roundToInt(frequency * std::pow(2.0, -1.0 / 6.0) / binWidth));
+    const auto last = juce::jlimit(first, lastBin, juce::roundToInt(frequency * std::pow(2.0, 1.0 / 6.0) / binWidth));
+
+    double sum = 0.0;
+    for (int bin = first; bin <= last; ++bin) {
+        sum += m_PowerSum[static_cast<size_t>(bin)];
+    }
+    const auto power = sum / (last - first + 1) / m_NumFrames;
+    return static_cast<float>(10.0 * std::log10(juce::jmax(power, 1e-20)));
+}
+
+EqMatcher::EqMatcher()
+    : juce::Thread("EqPT matcher"), m_InputBuffer(inputFifoSize)
+{
+}
+
+EqMatcher::~EqMatcher()
+{
+    cancelPendingUpdate();
+    signalThreadShouldExit();
+    notify();
+    // A fit in progress finishes its current search before the thread notices
+    stopThread(5000);
+}
+
+void EqMatcher::setParameterRange(FitParameter parameter, const juce::NormalisableRange<float>& range)
+{
+    const juce::ScopedLock sl(m_Lock);
+    m_Ranges[static_cast<size_t>(parameter)] = range;
+}
+
+void EqMatcher::prepare(double sampleRate)
+{
+    // Input captured at another rate cannot be mixed into the same average
+    if (m_SampleRate.exchange(sampleRate) != sampleRate) {
+        m_InputResetRequested = true;
+    }
+}
+
+void EqMatcher::pushInput(const juce::AudioBuffer<float>& buffer)
+{
+    if (!m_IsCapturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const auto numChannels = buffer.getNumChannels();
+    if (numChannels == 0) {
+        return;
+    }
+
+    // Whatever does not fit is dropped, the average does not need every sample
+    const auto scale = 1.f / numChannels;
+    auto scope = m_InputFifo.write(buffer.getNumSamples());
+    auto mixDown = [this, &buffer, numChannels, scale](int destination, int sourceOffset, int numSamples) {
+        auto* output = m_InputBuffer.data() + destination;
+        juce::FloatVectorOperations::copyWithMultiply(output, buffer.getReadPointer(0, sourceOffset), scale, numSamples);
+        for (int ch = 1; ch < numChannels; ++ch) {
+            juce::FloatVectorOperations::addWithMultiply(output, buffer.getReadPointer(ch, sourceOffset), scale, numSamples);
+        }
+    };
+    if (scope.blockSize1 > 0) {
+        mixDown(scope.startIndex1, 0, scope.blockSize1);
+    }
+    if (scope.blockSize2 > 0) {
+        mixDown(scope.startIndex2, scope.blockSize1, scope.blockSize2);
+    }
+}
+
+void EqMatcher::startInputCapture()
+{
+    m_InputResetRequested = true;
+    m_IsCapturing = true;
+    startThread();
+    notify();
+}
+
+void EqMatcher::stopInputCapture()
+{
+    m_IsCapturing = false;
+    notify();
+}
+
+void EqMatcher::setReferenceFile(const juce::File& file)
+{
+    {
+        const juce::ScopedLock sl(m_Lock);
+        m_PendingReference = file;
+    }
+    startThread();
+    notify();
+}
+
+void EqMatcher::startMatch()
+{
+    m_MatchRequested = true;
+    startThread();
+    notify();
+}
+
+juce::String EqMatcher::getLastError() const
+{
+    const juce::ScopedLock sl(m_Lock);
+    return m_LastError;
+}
+
+void EqMatcher::setError(const juce::String& error)
+{
+    const juce::ScopedLock sl(m_Lock);
+    m_LastError = error;
+}
+
+void EqMatcher::run()
+{
+    while (!threadShouldExit()) {
+        // Only a running capture needs the FIFO drained regularly
+        wait(m_IsCapturing.load() ? 20 : -1);
+
+        if (m_InputResetRequested.exchange(false)) {
+            drainInput(false);
+            m_InputSpectrum.reset(m_SampleRate.load());
+        }
+        drainInput(true);
+
+        juce::File reference;
+        {
+            const juce::ScopedLock sl(m_Lock);
+            std::swap(reference, m_PendingReference);
+        }
+        if (reference != juce::File()) {
+            analyseReference(reference);
+        }
+
+        if (m_MatchRequested.load()) {
+            m_IsMatching = true;
+            m_MatchRequested = false;
+            match();
+            m_IsMatching = false;
+        }
+    }
+}
+
+void EqMatcher::drainInput(bool keepSamples)
+{
+    auto scope = m_InputFifo.read(m_InputFifo.getNumReady());
+    if (!keepSamples) {
+        return;
+    }
+    m_InputSpectrum.addSamples(m_InputBuffer.data() + scope.startIndex1, scope.blockSize1);
+    m_InputSpectrum.addSamples(m_InputBuffer.data() + scope.startIndex2, scope.blockSize2);
+}
+
+void EqMatcher::analyseReference(const juce::File& file)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+    if (reader == nullptr || reader->numChannels == 0) {
+        setError("Could not read " + file.getFullPathName());
+        return;
+    }
+
+    constexpr int readBlockSize = 1 << 15;
+    const auto numChannels = static_cast<int>(reader->numChannels);
+    juce::AudioBuffer<float> block(numChannels, readBlockSize);
+    m_ReferenceSpectrum.reset(reader->sampleRate);
+
+    for (juce::int64 position = 0; position < reader->lengthInSamples && !threadShouldExit(); position += readBlockSize) {
+        const auto numSamples = static_cast<int>(juce::jmin<juce::int64>(readBlockSize, reader->lengthInSamples - position));
+        reader->read(&block, 0, numSamples, position, true, true);
+
+        auto* mono = block.getWritePointer(0);
+        juce::FloatVectorOperations::multiply(mono, 1.f / numChannels, numSamples);
+        for (int ch = 1; ch < numChannels; ++ch) {
+            juce::FloatVectorOperations::addWithMultiply(mono, block.getReadPointer(ch), 1.f / numChannels, numSamples);
+        }
+        m_ReferenceSpectrum.addSamples(mono, numSamples);
+    }
+
+    if (m_ReferenceSpectrum.getNumFrames() < minFramesForMatch) {
+        setError(file.getFileName() + " is too short to use as a reference");
+    }
+}
+
+void EqMatcher::match()
+{
+    if (m_InputSpectrum.getNumFrames() < minFramesForMatch) {
+        setError("Not enough input has been captured");
+        return;
+    }
+    if (m_ReferenceSpectrum.getNumFrames() < minFramesForMatch) {
+        setError("No reference has been analysed");
+        return;
+    }
+
+    const auto startMs = juce::Time::getMillisecondCounterHiRes();
+    Target target;
+    {
+        const juce::ScopedLock sl(m_Lock);
+        target.ranges = m_Ranges;
+    }
+    target.sampleRate = m_SampleRate.load();
+
+    // Log-spaced grid, padded to whole registers; the padding lanes carry no weight
+    const auto lanes = static_cast<int>(Vec::size());
+    const auto numVecs = (numGridPoints + lanes - 1) / lanes;
+    const auto lowest = 20.0;
+    const auto highest = juce::jmin(20000.0, 0.45 * target.sampleRate);
+    target.phi.resize(static_cast<size_t>(numVecs));
+    target.targetDb.assign(static_cast<size_t>(numVecs * lanes), 0.0);
+    target.weights.assign(static_cast<size_t>(numVecs * lanes), 0.0);
+
+    double meanDb = 0.0;
+    for (int i = 0; i < numVecs * lanes; ++i) {
+        const auto point = juce::jmin(i, numGridPoints - 1);
+        const auto frequency = lowest * std::pow(highest / lowest, static_cast<double>(point) / (numGridPoints - 1));
+        const auto sine = std::sin(juce::MathConstants<double>::pi * frequency / target.sampleRate);
+        target.phi[static_cast<size_t>(i / lanes)].set(static_cast<size_t>(i % lanes), sine * sine);
+        if (i < numGridPoints) {
+            target.targetDb[static_cast<size_t>(i)] = m_ReferenceSpectrum.getLevelDb(frequency) - m_InputSpectrum.getLevelDb(frequency);
+            target.weights[static_cast<size_t>(i)] = 1.0;
+            meanDb += target.targetDb[static_cast<size_t>(i)] / numGridPoints;
+        }
+    }
+    // Only the shape matters, the level difference is left to the output gain
+    for (int i = 0; i < numGridPoints; ++i) {
+        auto& value = target.targetDb[static_cast<size_t>(i)];
+        value = juce::jlimit(-30.0, 30.0, value - meanDb);
+    }
+
+    if (m_SearchPool == nullptr) {
+        m_SearchPool = std::make_unique<RenderThreadPool>(juce::jmax(0, juce::SystemStats::getNumCpus() - 1));
+    }
+    auto job = std::make_unique<SearchJob>(target);
+    m_SearchPool->run(*job, numStarts);
+
+    const auto best = static_cast<size_t>(std::min_element(job->bestCosts.begin(), job->bestCosts.end()) - job->bestCosts.begin());
+    auto point = job->bestPoints[best];
+    const auto cost = nelderMead(target, point, searchSchedule.back().first, searchSchedule.back().second);
+
+    Result result;
+    for (size_t p = 0; p < point.size(); ++p) {
+        const auto& range = target.ranges[p];
+        result.values[p] = range.snapToLegalValue(range.convertFrom0to1(static_cast<float>(point[p])));
+    }
+    result.rmsErrorDb = static_cast<float>(std::sqrt(cost));
+    result.fitMilliseconds = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    {
+        const juce::ScopedLock sl(m_Lock);
+        m_Result = std::make_unique<Result>(result);
+        m_LastError = {};
+    }
+    triggerAsyncUpdate();
+}
+
+void EqMatcher::handleAsyncUpdate()
+{
+    std::unique_ptr<Result> result;
+    {
+        const juce::ScopedLock sl(m_Lock);
+        std::swap(result, m_Result);
+    }
+    if (result != nullptr && onMatchFound != nullptr) {
+        onMatchFound(*result);
+    }
+}
+
+void EqMatcher::SearchJob::runJob(int index)
+{
+    juce::Random random(static_cast<juce::int64>(index) * 7919 + 17);
+    Point point;
+    for (auto& x : point) {
+        x = random.nextDouble();
+    }
+    // Each start begins from a flat response, with the cut filters near the edges of the band
+    for (auto p : { Fit_LowShelfGain, Fit_LowMidGain, Fit_MidGain, Fit_HighMidGain, Fit_HighShelfGain }) {
+        point[p] = target.ranges[p].convertTo0to1(0.f);
+    }
+    point[Fit_HpfFreq] *= 0.25;
+    point[Fit_LpfFreq] = 1.0 - 0.25 * point[Fit_LpfFreq];
+
+    // Restarting with a fresh, smaller simplex gets a search unstuck far more cheaply than letting it run on
+    auto cost = 0.0;
+    for (const auto& [step, maxEvaluations] : searchSchedule) {
+        cost = nelderMead(target, point, step, maxEvaluations);
+    }
+    bestCosts[static_cast<size_t>(index)] = cost;
+    bestPoints[static_cast<size_t>(index)] = point;
+}
+
+double EqMatcher::evaluate(const Target& target, const Point& point)
+{
+    using Coefficients = juce::dsp::IIR::ArrayCoefficients<double>;
+    auto value = [&target, &point](FitParameter p) {
+        return static_cast<double>(target.ranges[p].convertFrom0to1(static_cast<float>(point[p])));
+    };
+    auto slopeStages = [&value](FitParameter p) { return 1 + juce::jlimit(0, 2, juce::roundToInt(value(p))); };
+    const auto sampleRate = target.sampleRate;
+    // Clamped below Nyquist as BandArray clamps both of its topologies, so what is fitted is what the bands realise
+    auto frequency = [&value, sampleRate](FitParameter p) { return juce::jmin(value(p), 0.49 * sampleRate); };
+
+    std::array<std::array<double, 6>, maxStages> stages;
+    int numStages = 0;
+    for (int i = slopeStages(Fit_HpfSlope); --i >= 0;) {
+        stages[numStages++] = Coefficients::makeHighPass(sampleRate, frequency(Fit_HpfFreq));
+    }
+    stages[numStages++] = Coefficients::makeLowShelf(sampleRate, frequency(Fit_LowShelfFreq), value(Fit_LowShelfQ), juce::Decibels::decibelsToGain(value(Fit_LowShelfGain)));
+    stages[numStages++] = Coefficients::makePeakFilter(sampleRate, frequency(Fit_LowMidFreq), value(Fit_LowMidQ), juce::Decibels::decibelsToGain(value(Fit_LowMidGain)));
+    stages[numStages++] = Coefficients::makePeakFilter(sampleRate, frequency(Fit_MidFreq), value(Fit_MidQ), juce::Decibels::decibelsToGain(value(Fit_MidGain)));
+    stages[numStages++] = Coefficients::makePeakFilter(sampleRate, frequency(Fit_HighMidFreq), value(Fit_HighMidQ), juce::Decibels::decibelsToGain(value(Fit_HighMidGain)));
+    stages[numStages++] = Coefficients::makeHighShelf(sampleRate, frequency(Fit_HighShelfFreq), value(Fit_HighShelfQ), juce::Decibels::decibelsToGain(value(Fit_HighShelfGain)));
+    for (int i = slopeStages(Fit_LpfSlope); --i >= 0;) {
+        stages[numStages++] = Coefficients::makeLowPass(sampleRate, frequency(Fit_LpfFreq));
+    }
+
+    // |H|^2 as polynomials in phi = sin^2(w/2), which stay accurate at low frequencies:
+    // (c0+c1+c2)^2 - 4(c0c1 + 4c0c2 + c1c2)phi + 16c0c2 phi^2 for both numerator and denominator
+    std::array<std::array<Vec, 6>, maxStages> polynomials;
+    for (int s = 0; s < numStages; ++s) {
+        const auto& c = stages[static_cast<size_t>(s)];
+        auto& poly = polynomials[static_cast<size_t>(s)];
+        for (int part = 0; part < 2; ++part) {
+            const auto c0 = c[static_cast<size_t>(3 * part)];
+            const auto c1 = c[static_cast<size_t>(3 * part + 1)];
+            const auto c2 = c[static_cast<size_t>(3 * part + 2)];
+            poly[static_cast<size_t>(3 * part)] = Vec::expand((c0 + c1 + c2) * (c0 + c1 + c2));
+            poly[static_cast<size_t>(3 * part + 1)] = Vec::expand(-4.0 * (c0 * c1 + 4.0 * c0 * c2 + c1 * c2));
+            poly[static_cast<size_t>(3 * part + 2)] = Vec::expand(16.0 * c0 * c2);
+        }
+    }
+
+    const auto lanes = Vec::size();
+    double error = 0.0;
+    for (size_t v = 0; v < target.phi.size(); ++v) {
+        const auto phi = target.phi[v];
+        auto numerator = Vec::expand(1.0);
+        auto denominator = Vec::expand(1.0);
+        for (int s = 0; s < numStages; ++s) {
+            const auto& poly = polynomials[static_cast<size_t>(s)];
+            numerator = numerator * (poly[0] + phi * (poly[1] + phi * poly[2]));
+            denominator = denominator * (poly[3] + phi * (poly[4] + phi * poly[5]));
+        }
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const auto i = v * lanes + lane;
+            if (target.weights[i] == 0.0) {
+                continue;
+            }
+            const auto responseDb = 10.0 * std::log10(juce::jmax(numerator.get(lane), 1e-300) / juce::jmax(denominator.get(lane), 1e-300));
+            const auto difference = juce::jlimit(-60.0, 60.0, responseDb) - target.targetDb[i];
+            error += target.weights[i] * difference * difference;
+        }
+    }
+    error /= numGridPoints;
+
+    // A slight pull towards 0 dB keeps bands the curve does not need out of the way
+    double gainPenalty = 0.0;
+    for (auto p : { Fit_LowShelfGain, Fit_LowMidGain, Fit_MidGain, Fit_HighMidGain, Fit_HighShelfGain }) {
+        gainPenalty += value(p) * value(p);
+    }
+    return error + 0.002 * gainPenalty;
+}
+
+double EqMatcher::nelderMead(const Target& target, Point& point, double initialStep, int maxEvaluations)
+{
+    constexpr int n = numFitParameters;
+    auto clampPoint = [](Point& p) {
+        for (auto& x : p) {
+            x = juce::jlimit(0.0, 1.0, x);
+        }
+    };
+    // Moves from the centroid along the direction of the given point
+    auto along = [](const Point& centroid, const Point& p, double factor) {
+        Point result;
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = centroid[i] + factor * (p[i] - centroid[i]);
+        }
+        return result;
+    };
+
+    std::array<Point, n + 1> simplex;
+    std::array<double, n + 1> costs;
+    simplex[0] = point;
+    for (int i = 0; i < n; ++i) {
+        auto& vertex = simplex[static_cast<size_t>(i + 1)];
+        vertex = point;
+        vertex[static_cast<size_t>(i)] += point[static_cast<size_t>(i)] + initialStep <= 1.0 ? initialStep : -initialStep;
+    }
+    for (size_t i = 0; i < simplex.size(); ++i) {
+        costs[i] = evaluate(target, simplex[i]);
+    }
+    auto numEvaluations = n + 1;
+
+    std::array<size_t, n + 1> order;
+    std::iota(order.begin(), order.end(), size_t{ 0 });
+    while (numEvaluations < maxEvaluations) {
+        std::sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] < costs[b]; });
+        const auto best = order[0];
+        const auto worst = order[n];
+        const auto secondWorst = order[n - 1];
+        if (costs[worst] - costs[best] < 1e-6) {
+            break;
+        }
+
+        Point centroid{};
+        for (int i = 0; i < n; ++i) {
+            for (size_t d = 0; d < centroid.size(); ++d) {
+                centroid[d] += simplex[order[static_cast<size_t>(i)]][d] / n;
+            }
+        }
+
+        auto reflected = along(centroid, simplex[worst], -1.0);
+        clampPoint(reflected);
+        const auto reflectedCost = evaluate(target, reflected);
+        ++numEvaluations;
+
+        if (reflectedCost < costs[best]) {
+            auto expanded = along(centroid, simplex[worst], -2.0);
+            clampPoint(expanded);
+            const auto expandedCost = evaluate(target, expanded);
+            ++numEvaluations;
+            const auto useExpanded = expandedCost < reflectedCost;
+            simplex[worst] = useExpanded ? expanded : reflected;
+            costs[worst] = useExpanded ? expandedCost : reflectedCost;
+            continue;
+        }
+        if (reflectedCost < costs[secondWorst]) {
+            simplex[worst] = reflected;
+            costs[worst] = reflectedCost;
+            continue;
+        }
+
+        // Contract outside the simplex if the reflection helped at all, inside otherwise
+        const auto isOutside = reflectedCost < costs[worst];
+        const auto contracted = along(centroid, isOutside ? reflected : simplex[worst], 0.5);
+        const auto contractedCost = evaluate(target, contracted);
+        ++numEvaluations;
+        if (contractedCost < juce::jmin(reflectedCost, costs[worst])) {
+            simplex[worst] = contracted;
+            costs[worst] = contractedCost;
+            continue;
+        }
+
+        // Shrink everything towards the best vertex
+        for (size_t i = 0; i < simplex.size(); ++i) {
+            if (i == best) {
+                continue;
+            }
+            simplex[i] = along(simplex[best], simplex[i], 0.5);
+            costs[i] = evaluate(target, simplex[i]);
+            ++numEvaluations;
+        }
+    }
+
+    const auto best = static_cast<size_t>(std::min_element(costs.begin(), costs.end()) - costs.begin());
+    point = simplex[best];
+    return costs[best];
+}
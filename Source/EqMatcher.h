@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    Matches the tonal balance of the plugin input to a reference file.
+
+    Long-term averaged spectra of the input and the reference are captured,
+    and the default seven-band layout is fitted to their smoothed difference with a
+    multi-start Nelder-Mead search. Everything apart from handing input
+    samples over runs on the matcher's own thread, and the result is handed
+    back on the message thread as one set of parameter values.
+
+    The fit evaluates the bands as biquads whatever the filter topology is.
+    The SVF bands realise the same bilinear, prewarped prototypes, so both
+    topologies have the same magnitude response; they differ only in how
+    they move between settings.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "RenderThreadPool.h"
+
+class EqMatcher : private juce::Thread, private juce::AsyncUpdater
+{
+public:
+    // The band parameters the fit controls, in band order
+    enum FitParameter
+    {
+        Fit_HpfFreq,
+        Fit_HpfSlope,
+        Fit_LowShelfFreq,
+        Fit_LowShelfGain,
+        Fit_LowShelfQ,
+        Fit_LowMidFreq,
+        Fit_LowMidGain,
+        Fit_LowMidQ,
+        Fit_MidFreq,
+        Fit_MidGain,
+        Fit_MidQ,
+        Fit_HighMidFreq,
+        Fit_HighMidGain,
+        Fit_HighMidQ,
+        Fit_HighShelfFreq,
+        Fit_HighShelfGain,
+        Fit_HighShelfQ,
+        Fit_LpfFreq,
+        Fit_LpfSlope,
+        numFitParameters,
+    };
+
+    struct Result
+    {
+        std::array<float, numFitParameters> values;
+        // Root of the final fit cost, roughly the remaining RMS deviation from the target curve
+        float rmsErrorDb;
+        // Wall time of the fit, from the finished spectra to the result
+        double fitMilliseconds;
+    };
+
+    EqMatcher();
+    ~EqMatcher() override;
+
+    // Ranges are taken from the plugin parameters so the fit never proposes values the host cannot hold
+    void setParameterRange(FitParameter parameter, const juce::NormalisableRange<float>& range);
+    void prepare(double sampleRate);
+
+    // Called from the audio thread with the unprocessed input. Does nothing unless a capture is running.
+    void pushInput(const juce::AudioBuffer<float>& buffer);
+
+    void startInputCapture();
+    void stopInputCapture();
+    bool isCapturingInput() const { return m_IsCapturing.load(); }
+    // The file is decoded and analysed on the matcher thread
+    void setReferenceFile(const juce::File& file);
+    // Fits the bands to the captured spectra; onMatchFound is called on the message thread once done
+    void startMatch();
+    bool isMatching() const { return m_MatchRequested.load() || m_IsMatching.load(); }
+
+    juce::String getLastError() const;
+    std::function<void(const Result&)> onMatchFound;
+
+private:
+    // Power spectrum averaged over Hann-windowed frames with 50% overlap
+    class AveragedSpectrum
+    {
+    public:
+        static constexpr int fftOrder = 12;
+        static constexpr int fftSize = 1 << fftOrder;
+
+        AveragedSpectrum();
+        void reset(double sampleRate);
+        void addSamples(const float* samples, int numSamples);
+        int getNumFrames() const { return m_NumFrames; }
+        // Averaged level around the given frequency, smoothed over a third of an octave
+        float getLevelDb(double frequency) const;
+
+    private:
+        juce::dsp::FFT m_Fft{ fftOrder };
+        juce::dsp::WindowingFunction<float> m_Window{ static_cast<size_t>(fftSize), juce::dsp::WindowingFunction<float>::hann, false };
+        std::vector<float> m_Frame;
+        std::vector<float> m_FftData;
+        std::vector<double> m_PowerSum;
+        int m_FrameFill{ 0 };
+        int m_NumFrames{ 0 };
+        double m_SampleRate{ 44100.0 };
+    };
+
+    using Vec = juce::dsp::SIMDRegister<double>;
+    static constexpr int numGridPoints = 128;
+    static constexpr int numStarts = 32;
+    // Initial simplex size and evaluation budget of each restart within a start
+    static constexpr std::array<std::pair<double, int>, 3> searchSchedule{ { { 0.15, 2000 }, { 0.05, 1000 }, { 0.02, 1000 } } };
+    static constexpr int maxStages = 11;
+    static constexpr int inputFifoSize = 1 << 15;
+    static constexpr int minFramesForMatch = 8;
+
+    using Point = std::array<double, numFitParameters>;
+
+    // Frequency grid and target shared read-only by every search
+    struct Target
+    {
+        double sampleRate{ 44100.0 };
+        std::vector<Vec> phi;
+        std::vector<double> targetDb;
+        std::vector<double> weights;
+        std::array<juce::NormalisableRange<float>, numFitParameters> ranges;
+    };
+
+    struct SearchJob : public RenderThreadPool::Job
+    {
+        explicit SearchJob(const Target& t) : target(t) {}
+        void runJob(int index) override;
+        const Target& target;
+        std::array<Point, numStarts> bestPoints;
+        std::array<double, numStarts> bestCosts;
+    };
+
+    void run() override;
+    void handleAsyncUpdate() override;
+    void drainInput(bool keepSamples);
+    void analyseReference(const juce::File& file);
+    void match();
+    void setError(const juce::String& error);
+
+    static double evaluate(const Target& target, const Point& point);
+    static double nelderMead(const Target& target, Point& point, double initialStep, int maxEvaluations);
+
+    std::array<juce::NormalisableRange<float>, numFitParameters> m_Ranges;
+    std::atomic<double> m_SampleRate{ 44100.0 };
+
+    // Audio thread to matcher thread
+    juce::AbstractFifo m_InputFifo{ inputFifoSize };
+    std::vector<float> m_InputBuffer;
+    std::atomic<bool> m_IsCapturing{ false };
+    std::atomic<bool> m_InputResetRequested{ false };
+
+    AveragedSpectrum m_InputSpectrum;
+    AveragedSpectrum m_ReferenceSpectrum;
+    std::unique_ptr<RenderThreadPool> m_SearchPool;
+
+    juce::CriticalSection m_Lock;
+    juce::File m_PendingReference;
+    std::atomic<bool> m_MatchRequested{ false };
+    std::atomic<bool> m_IsMatching{ false };
+    std::unique_ptr<Result> m_Result;
+    juce::String m_LastError;
+
+    JUCE_DECLARE_NON_COPYABLE(EqMatcher)
+};
@@ -0,0 +1,27 @@
+/*
+  ==============================================================================
+
+    Stable 32-bit keys for parameter IDs.
+
+    A key is the FNV-1a hash of the ID string, so it stays the same however
+    the parameters are ordered and can be computed by code that does not
+    link JUCE, such as daemon clients.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace ParameterKey {
+
+    constexpr uint32_t fromID(const char* parameterID)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *parameterID != '\0'; ++parameterID) {
+            hash = (hash ^ static_cast<uint8_t>(*parameterID)) * 16777619u;
+        }
+        return hash;
+    }
+}
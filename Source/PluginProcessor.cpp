@@ -9,7 +9,29 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
-
+// The band parameter each matcher parameter is written to, in EqMatcher::FitParameter order.
+// The fit models the legacy layout, so these are the first seven bands.
+static constexpr std::array<Params::Parameters, EqMatcher::numFitParameters> matchedParameters{
+    Params::bandParameter(0, Params::Field_Freq),
+    Params::bandParameter(0, Params::Field_Slope),
+    Params::bandParameter(1, Params::Field_Freq),
+    Params::bandParameter(1, Params::Field_Gain),
+    Params::bandParameter(1, Params::Field_Q),
+    Params::bandParameter(2, Params::Field_Freq),
+    Params::bandParameter(2, Params::Field_Gain),
+    Params::bandParameter(2, Params::Field_Q),
+    Params::bandParameter(3, Params::Field_Freq),
+    Params::bandParameter(3, Params::Field_Gain),
+    Params::bandParameter(3, Params::Field_Q),
+    Params::bandParameter(4, Params::Field_Freq),
+    Params::bandParameter(4, Params::Field_Gain),
+    Params::bandParameter(4, Params::Field_Q),
+    Params::bandParameter(5, Params::Field_Freq),
+    Params::bandParameter(5, Params::Field_Gain),
+    Params::bandParameter(5, Params::Field_Q),
+    Params::bandParameter(6, Params::Field_Freq),
+    Params::bandParameter(6, Params::Field_Slope),
+};
 
 //==============================================================================
 EqPTAudioProcessor::EqPTAudioProcessor()
@@ -29,92 +51,66 @@ EqPTAudioProcessor::EqPTAudioProcessor()
     
     using namespace Params;
     using params = Params::Parameters;
-   
-    for (int i = static_cast<int>(params::HPF_FREQ); i <= static_cast<int>(params::HPF_BYPASS); i++) {
 
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<HPF>());
-        }
-    }
-    for (int i = static_cast<int>(params::LPF_FREQ); i <= static_cast<int>(params::LPF_BYPASS); i++) {
+    initialiseBands();
+    addBandListeners();
 
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<LPF>());
-        }
+    m_BlockEvents.reserve(parameterEventQueueSize);
+    for (int i = 0; i < numParameters; ++i) {
+        m_Parameters[static_cast<size_t>(i)] = m_TreeState.getParameter(ParameterNames[static_cast<params>(i)]);
+        m_RawValues[static_cast<size_t>(i)] = m_TreeState.getRawParameterValue(ParameterNames[static_cast<params>(i)]);
+        m_ParameterKeys[static_cast<size_t>(i)] = ParameterKey::fromID(ParameterNames[static_cast<params>(i)].toRawUTF8());
     }
 
-    for (int i = static_cast<int>(params::LOW_MID_FREQ); i <= static_cast<int>(params::HIGH_MID_BYPASS); i++) {
-        for (auto& filter : getAllParametricFilters()) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], filter);
-
-        }
-    }
-
-    for (int i = static_cast<int>(params::LOW_SHELF_FREQ); i <= static_cast<int>(params::LOW_SHELF_BYPASS); i++) {
-
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<LF>());
-        }
-    }
-    for (int i = static_cast<int>(params::HIGH_SHELF_FREQ); i <= static_cast<int>(params::HIGH_SHELF_BYPASS); i++) {
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<HF>());
-        }
+    for (int i = 0; i < EqMatcher::numFitParameters; ++i) {
+        m_Matcher.setParameterRange(static_cast<EqMatcher::FitParameter>(i), m_TreeState.getParameterRange(ParameterNames[matchedParameters[static_cast<size_t>(i)]]));
     }
+    m_Matcher.onMatchFound = [this](const EqMatcher::Result& result) { applyMatch(result); };
+}
 
-    for (int i = 0; i < m_MonoChains.size(); ++i) {
-        m_MonoChains[i].get<HPF>().isHPF = true;
-        m_MonoChains[i].get<LPF>().isHPF = false;
-
-        m_MonoChains[i].get<HPF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::HPF_FREQ])->load();  //20.f
-        m_MonoChains[i].get<LPF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::LPF_FREQ])->load();
-        
-        m_MonoChains[i].get<LF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::LOW_SHELF_FREQ])->load();
-        m_MonoChains[i].get<HF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::HIGH_SHELF_FREQ])->load();  //20.f
+EqPTAudioProcessor::~EqPTAudioProcessor()
+{
+    m_RenderPool.reset();
+    removeBandListeners();
+}
 
-        m_MonoChains[i].get<LMF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::LOW_MID_FREQ])->load();
-        m_MonoChains[i].get<MF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::MID_FREQ])->load();
-        m_MonoChains[i].get<HMF>().freq = m_TreeState.getRawParameterValue(ParameterNames[params::HIGH_MID_FREQ])->load();
-        m_MonoChains[i].get<LMF>().filterType = LMF;
-        m_MonoChains[i].get<MF>().filterType = MF;
-        m_MonoChains[i].get<HMF>().filterType = HMF;
+void EqPTAudioProcessor::initialiseBands()
+{
+    using namespace Params;
 
-        m_MonoChains[i].get<LF>().isLowShelf = true;
-        m_MonoChains[i].get<HF>().isLowShelf = false;
-      
+    // Every band starts flagged, so the first block designs it from its parameters
+    for (int set = 0; set < numChannelSets; ++set) {
+        for (int i = 0; i < maxBands; ++i) {
+            auto& band = m_Bands[static_cast<size_t>(set)][static_cast<size_t>(i)];
+            band.index = i;
+            band.channelSet = set;
+            band.paramsChanged = true;
+        }
     }
-
 }
 
-EqPTAudioProcessor::~EqPTAudioProcessor()
+void EqPTAudioProcessor::addBandListeners()
 {
     using namespace Params;
-    using params = Params::Parameters;
-    for (int i = static_cast<int>(params::HPF_FREQ); i <= static_cast<int>(params::HPF_BYPASS); i++) {
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.removeParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<HPF>());
-        }
-    }
-    for (int i = static_cast<int>(params::LPF_FREQ); i <= static_cast<int>(params::LPF_BYPASS); i++) {
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.removeParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<LPF>());
-        }
-    }
 
-    for (int i = static_cast<int>(params::LOW_MID_FREQ); i <= static_cast<int>(params::HIGH_MID_BYPASS); i++) {
-        for (auto& filter : getAllParametricFilters()) {
-            m_TreeState.addParameterListener(ParameterNames[static_cast<params>(i)], filter);
+    for (int set = 0; set < numChannelSets; ++set) {
+        for (int band = 0; band < maxBands; ++band) {
+            for (int field = 0; field < numBandFields; ++field) {
+                m_TreeState.addParameterListener(ParameterNames[bandParameter(band, static_cast<BandField>(field), set)], &m_Bands[static_cast<size_t>(set)][static_cast<size_t>(band)]);
+            }
         }
     }
-    for (int i = static_cast<int>(params::LOW_SHELF_FREQ); i <= static_cast<int>(params::LOW_SHELF_BYPASS); i++) {
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.removeParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<LF>());
-        }
+}
 
-    }
-    for (int i = static_cast<int>(params::HIGH_SHELF_FREQ); i <= static_cast<int>(params::HIGH_SHELF_BYPASS); i++) {
-        for (int c = 0; c < m_MonoChains.size(); ++c) {
-            m_TreeState.removeParameterListener(ParameterNames[static_cast<params>(i)], &m_MonoChains[c].get<HF>());
+void EqPTAudioProcessor::removeBandListeners()
+{
+    using namespace Params;
+
+    for (int set = 0; set < numChannelSets; ++set) {
+        for (int band = 0; band < maxBands; ++band) {
+            for (int field = 0; field < numBandFields; ++field) {
+                m_TreeState.removeParameterListener(ParameterNames[bandParameter(band, static_cast<BandField>(field), set)], &m_Bands[static_cast<size_t>(set)][static_cast<size_t>(band)]);
+            }
         }
     }
 }
@@ -184,18 +180,27 @@ void EqPTAudioProcessor::changeProgramName (int index, const juce::String& newNa
 //==============================================================================
 void EqPTAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    juce::dsp::ProcessSpec spec;
-    spec.numChannels = getNumOutputChannels();
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.sampleRate = sampleRate;
-    m_MonoChains[0].prepare(spec);
-    m_MonoChains[1].prepare(spec);
+    const auto numChannels = juce::jlimit(1, maxNumChannels, getTotalNumOutputChannels());
+    m_NumChannels = numChannels;
+    // Mid/side runs on the first two channel states, so there are always at least two
+    m_BandArray.prepare(sampleRate, juce::jmax(numChannelSets, numChannels));
+    // Redesigns every band for the new sample rate
+    markAllBandsChanged();
+    m_Matcher.prepare(sampleRate);
+
+    // Only offline renders use the pool; hosts prepare again when they switch to offline rendering
+    const auto numWorkers = juce::jmin(juce::SystemStats::getNumCpus() - 1, numChannels - 1);
+    if (!isNonRealtime() || numChannels < minChannelsForParallelRender || numWorkers < 1) {
+        m_RenderPool.reset();
+    }
+    else if (m_RenderPool == nullptr || m_RenderPool->getNumWorkers() != numWorkers) {
+        m_RenderPool = std::make_unique<RenderThreadPool>(numWorkers);
+    }
 }
 
 void EqPTAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    m_RenderPool.reset();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -205,12 +210,11 @@ bool EqPTAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) con
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
+    // Every channel gets its own filter state, so any layout up to maxNumChannels works.
     // Some plugin hosts, such as certain GarageBand versions, will only
     // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    const auto numChannels = layouts.getMainOutputChannelSet().size();
+    if (numChannels < 1 || numChannels > maxNumChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -234,334 +238,447 @@ void EqPTAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::M
         buffer.clear (i, 0, buffer.getNumSamples());
 
 
+    m_Matcher.pushInput(buffer);
+    collectParameterEvents();
+
     juce::dsp::AudioBlock<float> block(buffer);
-    auto leftBlock = block.getNumChannels() > 1 ? block.getSingleChannelBlock(0) : block;
-    auto rightBlock = block.getNumChannels() > 1 ? block.getSingleChannelBlock(1) : block;
-    
-	updateFilters();
+    const auto numSamples = static_cast<int>(block.getNumSamples());
+    const auto minSegmentLength = juce::jmax(1, m_MinSegmentLength.load());
+    size_t nextEvent = 0;
+    int segmentStart = 0;
+
+    while (segmentStart < numSamples) {
+        // Everything due before the minimum segment length has elapsed is applied at the segment start
+        while (nextEvent < m_BlockEvents.size() && m_BlockEvents[nextEvent].sampleOffset < segmentStart + minSegmentLength) {
+            applyParameterEvent(m_BlockEvents[nextEvent++]);
+        }
+        const auto segmentEnd = nextEvent < m_BlockEvents.size()
+            ? juce::jmin(m_BlockEvents[nextEvent].sampleOffset, numSamples)
+            : numSamples;
 
-    m_MonoChains[0].process(juce::dsp::ProcessContextReplacing<float>(leftBlock));
-    m_MonoChains[1].process(juce::dsp::ProcessContextReplacing<float>(rightBlock));
-    
-    if (m_TreeState.getRawParameterValue(Params::ParameterNames[Params::Parameters::POLARITY_FLIP])->load() == true) {
-        buffer.applyGain(-1.f);
+        updateFilters();
+        auto segment = block.getSubBlock(static_cast<size_t>(segmentStart), static_cast<size_t>(segmentEnd - segmentStart));
+        processSegment(segment);
+        segmentStart = segmentEnd;
     }
 
-	buffer.applyGain(juce::Decibels::decibelsToGain(m_TreeState.getRawParameterValue(Params::ParameterNames[Params::Parameters::OUT_GAIN])->load()));
-    
+    // Events stamped beyond the end of this block take effect from the start of the next one
+    while (nextEvent < m_BlockEvents.size()) {
+        applyParameterEvent(m_BlockEvents[nextEvent++]);
+    }
+    m_BlockEvents.clear();
+}
+
+void EqPTAudioProcessor::processSegment(juce::dsp::AudioBlock<float>& block)
+{
+    m_SegmentGain = juce::Decibels::decibelsToGain(m_Globals.outputGain);
+    if (m_Globals.isPolarityFlipped) {
+        m_SegmentGain = -m_SegmentGain;
+    }
+
+    const auto numChannels = juce::jmin(static_cast<int>(block.getNumChannels()), m_NumChannels);
+    m_SegmentIsMidSide = m_Globals.stereoMode == Stereo_MidSide && numChannels >= 2;
+    const auto useRenderPool = m_RenderPool != nullptr
+        && isNonRealtime()
+        && numChannels >= minChannelsForParallelRender
+        && static_cast<int>(block.getNumSamples()) >= minSamplesForParallelRender;
 
+    if (!useRenderPool) {
+        processChannels(block, 0, numChannels);
+        return;
+    }
 
+    // A couple of groups per thread keeps the threads busy when some finish early
+    const auto targetJobs = juce::jmin(numChannels, 2 * (m_RenderPool->getNumWorkers() + 1));
+    m_ChannelGroupJob.block = &block;
+    m_ChannelGroupJob.numChannels = numChannels;
+    m_ChannelGroupJob.channelsPerJob = (numChannels + targetJobs - 1) / targetJobs;
+    if (m_SegmentIsMidSide) {
+        // The mid/side pair has to stay within one group
+        m_ChannelGroupJob.channelsPerJob = juce::jmax(2, m_ChannelGroupJob.channelsPerJob);
+    }
+    m_RenderPool->run(m_ChannelGroupJob, (numChannels + m_ChannelGroupJob.channelsPerJob - 1) / m_ChannelGroupJob.channelsPerJob);
 }
 
-//==============================================================================
-bool EqPTAudioProcessor::hasEditor() const
+void EqPTAudioProcessor::processChannels(juce::dsp::AudioBlock<float>& block, int firstChannel, int numChannels)
 {
-    return true; // (change this to false if you choose to not supply an editor)
+    auto c = firstChannel;
+    if (m_SegmentIsMidSide && firstChannel == 0 && numChannels >= 2) {
+        processMidSide(block);
+        c = 2;
+    }
+    for (; c < firstChannel + numChannels; ++c) {
+        auto* data = block.getChannelPointer(static_cast<size_t>(c));
+        m_BandArray.process(getChannelSet(c), c, [data](int i) { return data[i]; }, data, static_cast<int>(block.getNumSamples()), m_SegmentGain);
+    }
 }
 
-juce::AudioProcessorEditor* EqPTAudioProcessor::createEditor()
+void EqPTAudioProcessor::processMidSide(juce::dsp::AudioBlock<float>& block)
 {
-    return new juce::GenericAudioProcessorEditor(*this);
-    //return new NewProjectAudioProcessorEditor (*this);
+    const auto* left = block.getChannelPointer(0);
+    const auto* right = block.getChannelPointer(1);
+    auto* leftOut = block.getChannelPointer(0);
+    auto* rightOut = block.getChannelPointer(1);
+    const auto numSamples = static_cast<int>(block.getNumSamples());
+    const auto gain = m_SegmentGain;
+
+    std::array<float, midSideTileSize> mid, side;
+
+    for (int start = 0; start < numSamples; start += midSideTileSize) {
+        const auto tileSize = juce::jmin(midSideTileSize, numSamples - start);
+        const auto* l = left + start;
+        const auto* r = right + start;
+        m_BandArray.process(0, 0, [l, r](int i) { return 0.5f * (l[i] + r[i]); }, mid.data(), tileSize, 1.f);
+        m_BandArray.process(1, 1, [l, r](int i) { return 0.5f * (l[i] - r[i]); }, side.data(), tileSize, 1.f);
+
+        // Decoding and the output gain share the write back
+        for (int i = 0; i < tileSize; ++i) {
+            leftOut[start + i] = gain * (mid[static_cast<size_t>(i)] + side[static_cast<size_t>(i)]);
+            rightOut[start + i] = gain * (mid[static_cast<size_t>(i)] - side[static_cast<size_t>(i)]);
+        }
+    }
 }
 
-//==============================================================================
-void EqPTAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
+void EqPTAudioProcessor::ChannelGroupJob::runJob(int index)
 {
-    juce::MemoryOutputStream mos(destData, true);
-    m_TreeState.state.writeToStream(mos);
+    const auto firstChannel = index * channelsPerJob;
+    processor.processChannels(*block, firstChannel, juce::jmin(channelsPerJob, numChannels - firstChannel));
 }
 
-void EqPTAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
+bool EqPTAudioProcessor::pushParameterEvent(Params::Parameters parameter, float value, int sampleOffset)
 {
-    juce::MemoryInputStream stream(data, sizeInBytes, true);
-    auto state = juce::ValueTree::readFromStream(stream);
-    if (state.isValid())
-        m_TreeState.replaceState(state);
+    auto scope = m_EventFifo.write(1);
+    if (scope.blockSize1 + scope.blockSize2 == 0) {
+        return false;
+    }
+    auto& event = m_EventQueue[static_cast<size_t>(scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2)];
+    event = { parameter, value, juce::jmax(0, sampleOffset) };
+    return true;
 }
 
-juce::AudioProcessorValueTreeState::ParameterLayout EqPTAudioProcessor::createLayout()
-{   
+void EqPTAudioProcessor::setMinimumSegmentLength(int numSamples)
+{
+    m_MinSegmentLength = juce::jmax(1, numSamples);
+}
+
+void EqPTAudioProcessor::applyMatch(const EqMatcher::Result& result)
+{
     using namespace Params;
     using params = Params::Parameters;
-    using floatRange = juce::NormalisableRange<float>;
-   
-    auto layout = juce::AudioProcessorValueTreeState::ParameterLayout();
-    auto addFloatParam = [&layout](params p, floatRange nr, float defVal) {layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterNames[p], ParameterNames[p], nr, defVal)); };
-    auto addBoolParam = [&layout](params p, bool defVal) {layout.add(std::make_unique<juce::AudioParameterBool>(ParameterNames[p], ParameterNames[p], defVal)); };
-    auto addChoiceParam = [&layout](params p, juce::StringArray sa, int defVal) {layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterNames[p], ParameterNames[p], sa, defVal)); };
-    
-    addFloatParam(params::OUT_GAIN, floatRange(-60.f, 12.f, 0.5f, 1.5f), 0.f);
-    addBoolParam(params::POLARITY_FLIP, false);
-    addFloatParam(params::HPF_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 20.f);
-    addChoiceParam(params::HPF_SLOPE, juce::StringArray{ "12 db/oct", "24 db/oct", "36 db/oct" }, 1);
-    addBoolParam(params::HPF_BYPASS, false);
-    addFloatParam(params::LOW_SHELF_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 100.f);
-    addFloatParam(params::LOW_SHELF_GAIN, floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
-    addFloatParam(params::LOW_SHELF_Q, floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
-    addBoolParam(params::LOW_SHELF_BYPASS, false);
-    addFloatParam(params::LOW_MID_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 200.f);
-    addFloatParam(params::LOW_MID_GAIN, floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
-    addFloatParam(params::LOW_MID_Q, floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
-    addBoolParam(params::LOW_MID_BYPASS, false);
-    addFloatParam(params::MID_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 1000.f);
-    addFloatParam(params::MID_GAIN, floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
-    addFloatParam(params::MID_Q, floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
-    addBoolParam(params::MID_BYPASS, false);
-    addFloatParam(params::HIGH_MID_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 4000.f);
-    addFloatParam(params::HIGH_MID_GAIN, floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
-    addFloatParam(params::HIGH_MID_Q, floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
-    addBoolParam(params::HIGH_MID_BYPASS, false);
-    addFloatParam(params::HIGH_SHELF_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 10000.f);
-    addFloatParam(params::HIGH_SHELF_GAIN, floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
-    addFloatParam(params::HIGH_SHELF_Q, floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
-    addBoolParam(params::HIGH_SHELF_BYPASS, false);
-    addFloatParam(params::LPF_FREQ, floatRange(20.f, 20000.f, 1.f, 0.25f), 20000.f);
-    addChoiceParam(params::LPF_SLOPE, juce::StringArray{ "12 db/oct", "24 db/oct", "36 db/oct" }, 1);
-    addBoolParam(params::LPF_BYPASS, false);
-    return layout;
+
+    {
+        ScopedParameterBatch batch(*this);
+        auto setParameter = [this](params p, float value) {
+            auto* parameter = m_Parameters[static_cast<size_t>(p)];
+            parameter->beginChangeGesture();
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+            parameter->endChangeGesture();
+        };
+        // The fit models the legacy layout, so that is what the bands are set to; bands beyond it are switched off
+        setParameter(params::BAND_COUNT, static_cast<float>(numLegacyBands));
+        // Both sets get the match, so it applies the same way in every stereo mode
+        for (int set = 0; set < numChannelSets; ++set) {
+            for (int band = 0; band < numLegacyBands; ++band) {
+                setParameter(bandParameter(band, Field_Type, set), static_cast<float>(legacyBandTypes[static_cast<size_t>(band)]));
+                setParameter(bandParameter(band, Field_Bypass, set), 0.f);
+            }
+            for (size_t i = 0; i < matchedParameters.size(); ++i) {
+                setParameter(forChannelSet(matchedParameters[i], set), result.values[i]);
+            }
+        }
+    }
+    if (onMatchApplied != nullptr) {
+        onMatchApplied(result);
+    }
 }
 
-void EqPTAudioProcessor::updateFilters()
+void EqPTAudioProcessor::collectParameterEvents()
 {
-    for (int i = 0; i < m_MonoChains.size(); ++i) {
-        updateCutFilter(m_MonoChains[i].get<HPF>());
-        updateCutFilter(m_MonoChains[i].get<LPF>());
+    auto scope = m_EventFifo.read(m_EventFifo.getNumReady());
+    auto insertSorted = [this](const ParameterEvent& event) {
+        // Keeps arrival order for events sharing a timestamp
+        auto position = m_BlockEvents.end();
+        while (position != m_BlockEvents.begin() && std::prev(position)->sampleOffset > event.sampleOffset) {
+            --position;
+        }
+        m_BlockEvents.insert(position, event);
+    };
+    for (int i = 0; i < scope.blockSize1; ++i) {
+        insertSorted(m_EventQueue[static_cast<size_t>(scope.startIndex1 + i)]);
+    }
+    for (int i = 0; i < scope.blockSize2; ++i) {
+        insertSorted(m_EventQueue[static_cast<size_t>(scope.startIndex2 + i)]);
     }
-    updateShelfFilters();
-    updateParametricFilters();
 }
 
-void EqPTAudioProcessor::updateCutFilter(CutFilter& filter)
+void EqPTAudioProcessor::applyParameterEvent(const ParameterEvent& event)
 {
-    if (!filter.paramsChanged) {
-        return;
-    }
-    filter.setBypassed<0>(true);
-    filter.setBypassed<1>(true);
-    filter.setBypassed<2>(true);
-    
-    if (!filter.isBypassed)
-    {
-        switch (filter.slope) {
-        case 2: {
-            filter.get<2>().coefficients =
-                filter.isHPF
-                ? juce::dsp::IIR::Coefficients<float>::makeHighPass(getSampleRate(), filter.freq)
-                : juce::dsp::IIR::Coefficients<float>::makeLowPass(getSampleRate(), filter.freq);
-            filter.setBypassed<2>(false);
+    // The parameter's listeners take the change on, exactly as for a change made by the host or the editor
+    auto* parameter = m_Parameters[static_cast<size_t>(event.parameter)];
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(event.value));
+}
 
-        }
-        case 1: {
-            filter.get<1>().coefficients =
-                filter.isHPF
-                ? juce::dsp::IIR::Coefficients<float>::makeHighPass(getSampleRate(), filter.freq)
-                : juce::dsp::IIR::Coefficients<float>::makeLowPass(getSampleRate(), filter.freq);
-            filter.setBypassed<1>(false);
-        }
-        case 0: {
-            filter.get<0>().coefficients =
-                filter.isHPF
-                ? juce::dsp::IIR::Coefficients<float>::makeHighPass(getSampleRate(), filter.freq)
-                : juce::dsp::IIR::Coefficients<float>::makeLowPass(getSampleRate(), filter.freq);
-            filter.setBypassed<0>(false);
-            break;
-        }
+//==============================================================================
+bool EqPTAudioProcessor::hasEditor() const
+{
+    return true; // (change this to false if you choose to not supply an editor)
+}
 
-        default: jassert(false);
-        }
-    }
-    filter.paramsChanged = false;
+juce::AudioProcessorEditor* EqPTAudioProcessor::createEditor()
+{
+    return new juce::GenericAudioProcessorEditor(*this);
+    //return new NewProjectAudioProcessorEditor (*this);
 }
 
-juce::Array<PeakFilter*> EqPTAudioProcessor::getAllParametricFilters()
+//==============================================================================
+void EqPTAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    juce::Array<PeakFilter*> output;
-    for (int i = 0; i < m_MonoChains.size(); ++i) {
-        output.add(&m_MonoChains[i].get<LMF>());
-        output.add(&m_MonoChains[i].get<MF>());
-        output.add(&m_MonoChains[i].get<HMF>());
+    juce::MemoryOutputStream mos(destData, true);
+    mos.writeInt(stateMagic);
+    mos.writeInt(stateVersion);
+    mos.writeInt(Params::numParameters);
+    for (size_t i = 0; i < m_Parameters.size(); ++i) {
+        mos.writeInt(static_cast<int>(m_ParameterKeys[i]));
+        mos.writeFloat(m_Parameters[i]->convertFrom0to1(m_Parameters[i]->getValue()));
     }
-    return output;
-
 }
 
-juce::Array<ShelfFilter*> EqPTAudioProcessor::getAllShelfFilters()
+void EqPTAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    juce::Array<ShelfFilter*> output;
-    for (int i = 0; i < m_MonoChains.size(); ++i) {
-        output.add(&m_MonoChains[i].get<LF>());
-        output.add(&m_MonoChains[i].get<HF>());
+    ParameterValues values;
+    juce::MemoryInputStream stream(data, static_cast<size_t>(juce::jmax(0, sizeInBytes)), false);
+    const auto isBinary = sizeInBytes >= 3 * static_cast<int>(sizeof(int)) && stream.readInt() == stateMagic;
+    const auto isValid = isBinary
+        ? readBinaryState(stream, values)
+        : readLegacyState(data, sizeInBytes, values);
+    if (isValid) {
+        setParameterValues(values);
     }
-
-    return output;
 }
 
-
-void EqPTAudioProcessor::updateParametricFilters()
+bool EqPTAudioProcessor::readBinaryState(juce::MemoryInputStream& stream, ParameterValues& values) const
 {
-    auto filters = getAllParametricFilters();
-    for (auto& filter : filters) {
-        if (!filter->paramsChanged) {
-            continue;
-        }
-        switch (filter->filterType) {
-        case LMF: {
-            m_MonoChains[0].setBypassed<LMF>(filter->isBypassed);
-            m_MonoChains[1].setBypassed<LMF>(filter->isBypassed);
-            break;
-        }
-        case MF: {
-            m_MonoChains[0].setBypassed<MF>(filter->isBypassed);
-            m_MonoChains[1].setBypassed<MF>(filter->isBypassed);
-            break;
-        }
-        case HMF: {
-            m_MonoChains[0].setBypassed<HMF>(filter->isBypassed);
-            m_MonoChains[1].setBypassed<HMF>(filter->isBypassed);
-            break;
-        }
+    constexpr auto entrySize = static_cast<juce::int64>(sizeof(juce::uint32) + sizeof(float));
+    const auto version = stream.readInt();
+    const auto count = stream.readInt();
+    if (version != stateVersion || count < 0 || stream.getNumBytesRemaining() < static_cast<juce::int64>(count) * entrySize) {
+        return false;
+    }
+    // Keys this build does not know belong to removed parameters and are skipped
+    for (int i = 0; i < count; ++i) {
+        const auto key = static_cast<juce::uint32>(stream.readInt());
+        const auto value = stream.readFloat();
+        if (const auto parameter = Params::findParameter(key)) {
+            values[static_cast<size_t>(*parameter)] = value;
         }
-        filter->coefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter(getSampleRate(), filter->freq, filter->q, juce::Decibels::decibelsToGain(filter->gain));
-        filter->paramsChanged = false;
     }
+    return true;
 }
 
-
-void EqPTAudioProcessor::updateShelfFilters()
+// Blobs saved before the binary layout hold the whole tree state, with one PARAM child per parameter.
+// They always come from the fixed layout, whose bands kept their IDs.
+bool EqPTAudioProcessor::readLegacyState(const void* data, int sizeInBytes, ParameterValues& values) const
 {
-    auto filters = getAllShelfFilters();
-    for (auto& filter : filters) {
-        if (!filter->paramsChanged) {
+    using namespace Params;
+
+    const auto state = juce::ValueTree::readFromData(data, static_cast<size_t>(juce::jmax(0, sizeInBytes)));
+    if (!state.isValid() || !state.hasType(m_TreeState.state.getType())) {
+        return false;
+    }
+    for (const auto& child : state) {
+        if (!child.hasType("PARAM")) {
             continue;
         }
-        if (filter->isLowShelf) {
-            m_MonoChains[0].setBypassed<LF>(filter->isBypassed);
-            m_MonoChains[1].setBypassed<LF>(filter->isBypassed);
+        const auto id = child.getProperty("id").toString();
+        if (const auto parameter = findParameter(ParameterKey::fromID(id.toRawUTF8()))) {
+            values[static_cast<size_t>(*parameter)] = static_cast<float>(child.getProperty("value"));
         }
-        else {
-            m_MonoChains[0].setBypassed<HF>(filter->isBypassed);
-            m_MonoChains[1].setBypassed<HF>(filter->isBypassed);
+    }
+    // Sessions from before the second band set start it as a copy of the first
+    for (int i = 0; i < numBandParameters; ++i) {
+        const auto first = static_cast<size_t>(forChannelSet(bandParameter(0, Field_Type), 0)) + static_cast<size_t>(i);
+        const auto second = static_cast<size_t>(forChannelSet(bandParameter(0, Field_Type), 1)) + static_cast<size_t>(i);
+        if (!values[second].has_value()) {
+            values[second] = values[first];
         }
-        filter->coefficients =
-            filter->isLowShelf
-            ? juce::dsp::IIR::Coefficients<float>::makeLowShelf(getSampleRate(), filter->freq, filter->q, juce::Decibels::decibelsToGain(filter->gain))
-            : juce::dsp::IIR::Coefficients<float>::makeHighShelf(getSampleRate(), filter->freq, filter->q, juce::Decibels::decibelsToGain(filter->gain));
-        filter->paramsChanged = false;
     }
+    setLegacyLayout(values);
+    return true;
 }
 
+// The fixed layout had no band count or band types; its sessions get the bands it had
+void EqPTAudioProcessor::setLegacyLayout(ParameterValues& values)
+{
+    using namespace Params;
 
+    values[static_cast<size_t>(Parameters::BAND_COUNT)] = static_cast<float>(numLegacyBands);
+    for (int set = 0; set < numChannelSets; ++set) {
+        for (int band = 0; band < numLegacyBands; ++band) {
+            values[static_cast<size_t>(bandParameter(band, Field_Type, set))] = static_cast<float>(legacyBandTypes[static_cast<size_t>(band)]);
+        }
+    }
+}
 
-//==============================================================================
-// This creates new instances of the plugin..
-juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+void EqPTAudioProcessor::setParameterValues(const ParameterValues& values)
 {
-    return new EqPTAudioProcessor();
+    // Parameters the state does not hold go back to their defaults, as a restored tree state would.
+    // Unchanged parameters are skipped, and the batch leaves the rest to a single redesign.
+    ScopedParameterBatch batch(*this);
+    for (size_t i = 0; i < values.size(); ++i) {
+        auto* parameter = m_Parameters[i];
+        const auto normalisedValue = values[i].has_value() ? parameter->convertTo0to1(*values[i]) : parameter->getDefaultValue();
+        if (normalisedValue != parameter->getValue()) {
+            parameter->setValueNotifyingHost(normalisedValue);
+        }
+    }
 }
 
-void CutFilter::parameterChanged(const juce::String& parameterID, float newValue)
-{
+juce::AudioProcessorValueTreeState::ParameterLayout EqPTAudioProcessor::createLayout()
+{   
     using namespace Params;
     using params = Params::Parameters;
+    using floatRange = juce::NormalisableRange<float>;
+   
+    auto layout = juce::AudioProcessorValueTreeState::ParameterLayout();
+    auto addFloatParam = [&layout](params p, floatRange nr, float defVal) {layout.add(std::make_unique<juce::AudioParameterFloat>(ParameterNames[p], getParameterDisplayName(p), nr, defVal)); };
+    auto addBoolParam = [&layout](params p, bool defVal) {layout.add(std::make_unique<juce::AudioParameterBool>(ParameterNames[p], getParameterDisplayName(p), defVal)); };
+    auto addChoiceParam = [&layout](params p, juce::StringArray sa, int defVal) {layout.add(std::make_unique<juce::AudioParameterChoice>(ParameterNames[p], getParameterDisplayName(p), sa, defVal)); };
+    auto addIntParam = [&layout](params p, int min, int max, int defVal) {layout.add(std::make_unique<juce::AudioParameterInt>(ParameterNames[p], getParameterDisplayName(p), min, max, defVal)); };
     
-    if (parameterID == ParameterNames[params::HPF_FREQ] && isHPF) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::HPF_SLOPE] && isHPF) {
-        slope = (CutSlope)newValue;
-    }
-    if (parameterID == ParameterNames[params::HPF_BYPASS] && isHPF) {
-        isBypassed = newValue;
-    }
-
-    if (parameterID == ParameterNames[params::LPF_FREQ] && !isHPF) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::LPF_SLOPE] && !isHPF) {
-        slope = (CutSlope)newValue;
-    }
-    if (parameterID == ParameterNames[params::LPF_BYPASS] && !isHPF) {
-        isBypassed = newValue;
+    addFloatParam(params::OUT_GAIN, floatRange(-60.f, 12.f, 0.5f, 1.5f), 0.f);
+    addBoolParam(params::POLARITY_FLIP, false);
+    addChoiceParam(params::FILTER_TOPOLOGY, juce::StringArray{ "Biquad", "SVF" }, 0);
+    addChoiceParam(params::STEREO_MODE, juce::StringArray{ "Linked", "L/R Unlinked", "M/S" }, 0);
+    addIntParam(params::BAND_COUNT, 1, maxBands, numLegacyBands);
+
+    // Bands beyond the legacy layout start as flat peaks
+    const std::array<float, numLegacyBands> legacyFrequencies{ 20.f, 100.f, 200.f, 1000.f, 4000.f, 10000.f, 20000.f };
+    for (int set = 0; set < numChannelSets; ++set) {
+        for (int band = 0; band < maxBands; ++band) {
+            const auto isLegacyBand = band < numLegacyBands;
+            auto inBand = [set, band](BandField field) { return bandParameter(band, field, set); };
+            addChoiceParam(inBand(Field_Type), juce::StringArray{ "Peak", "Low Shelf", "High Shelf", "Low Cut", "High Cut", "Notch", "Tilt" },
+                           isLegacyBand ? legacyBandTypes[static_cast<size_t>(band)] : Band_Peak);
+            addFloatParam(inBand(Field_Freq), floatRange(20.f, 20000.f, 1.f, 0.25f), isLegacyBand ? legacyFrequencies[static_cast<size_t>(band)] : 1000.f);
+            addFloatParam(inBand(Field_Gain), floatRange(-24.f, 24.f, 0.5f, 1.f), 0.f);
+            addFloatParam(inBand(Field_Q), floatRange(0.1f, 5.f, 0.1f, 1.f), 1.f);
+            addChoiceParam(inBand(Field_Slope), juce::StringArray{ "12 db/oct", "24 db/oct", "36 db/oct" }, 1);
+            addBoolParam(inBand(Field_Bypass), false);
+        }
     }
-    paramsChanged = true;
+    return layout;
 }
 
-void PeakFilter::parameterChanged(const juce::String& parameterID, float newValue)
+void EqPTAudioProcessor::updateFilters()
 {
     using namespace Params;
     using params = Params::Parameters;
-    
-    if (parameterID == ParameterNames[params::LOW_MID_FREQ] && filterType == LMF) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_MID_GAIN] && filterType == LMF) {
-        gain = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_MID_Q] && filterType == LMF) {
-        q = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_MID_BYPASS] && filterType == LMF) {
-        isBypassed = newValue;
-    }
-    if (parameterID == ParameterNames[params::MID_FREQ] && filterType == MF) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::MID_GAIN] && filterType == MF) {
-        gain = newValue;
+
+    // Nothing is taken over while a batch is being written
+    const auto sequence = m_ParameterBatchSequence.load();
+    if ((sequence & 1u) != 0) {
+        return;
     }
-    if (parameterID == ParameterNames[params::MID_Q] && filterType == MF) {
-        q = newValue;
+
+    GlobalSettings globals;
+    globals.outputGain = getRawValue(params::OUT_GAIN);
+    globals.isPolarityFlipped = getRawValue(params::POLARITY_FLIP) >= 0.5f;
+    globals.topology = static_cast<FilterTopology>(static_cast<int>(getRawValue(params::FILTER_TOPOLOGY)));
+    globals.stereoMode = static_cast<StereoMode>(static_cast<int>(getRawValue(params::STEREO_MODE)));
+    globals.numBands = juce::jlimit(1, maxBands, static_cast<int>(getRawValue(params::BAND_COUNT)));
+
+    // A new topology needs every band designed for it; if this pass is dropped the flags simply stay up
+    if (globals.topology != m_Globals.topology) {
+        markAllBandsChanged();
     }
-    if (parameterID == ParameterNames[params::MID_BYPASS] && filterType == MF) {
-        isBypassed = newValue;
+
+    // Bands past the count and, in linked mode, the second set keep their changes pending until they are used
+    const auto numDesignSets = globals.stereoMode == Stereo_Linked ? 1 : numChannelSets;
+    size_t numStaged = 0;
+    for (int set = 0; set < numDesignSets; ++set) {
+        for (int i = 0; i < globals.numBands; ++i) {
+            auto& band = m_Bands[static_cast<size_t>(set)][static_cast<size_t>(i)];
+            if (band.paramsChanged.exchange(false)) {
+                m_StagedBands[numStaged++] = { &band, readBandSettings(set, i) };
+            }
+        }
     }
-    if (parameterID == ParameterNames[params::HIGH_MID_FREQ] && filterType == HMF) {
-        freq = newValue;
+
+    // A batch started while reading, so what was read may be half of it; the next segment tries again
+    if (m_ParameterBatchSequence.load() != sequence) {
+        for (size_t i = 0; i < numStaged; ++i) {
+            m_StagedBands[i].band->paramsChanged = true;
+        }
+        return;
     }
-    if (parameterID == ParameterNames[params::HIGH_MID_GAIN] && filterType == HMF) {
-        gain = newValue;
+
+    if (globals.topology != m_Globals.topology) {
+        // Before the redesigns below, which are made for the topology that is set
+        m_BandArray.setTopology(globals.topology);
     }
-    if (parameterID == ParameterNames[params::HIGH_MID_Q] && filterType == HMF) {
-        q = newValue;
+    const auto isLayoutChanged = globals.numBands != m_Globals.numBands || globals.stereoMode != m_Globals.stereoMode;
+    m_Globals = globals;
+
+    std::array<bool, numChannelSets> isSetChanged;
+    isSetChanged.fill(isLayoutChanged);
+    for (size_t i = 0; i < numStaged; ++i) {
+        const auto& staged = m_StagedBands[i];
+        m_BandArray.designBand(staged.band->channelSet, staged.band->index, staged.settings);
+        isSetChanged[static_cast<size_t>(staged.band->channelSet)] = true;
     }
-    if (parameterID == ParameterNames[params::HIGH_MID_BYPASS] && filterType == HMF) {
-        isBypassed = newValue;
+    for (int set = 0; set < numDesignSets; ++set) {
+        if (isSetChanged[static_cast<size_t>(set)]) {
+            m_BandArray.updateActiveStages(set, globals.numBands);
+        }
     }
-    DBG(filterType << ", " << freq << ", " << gain);
-    paramsChanged = true;
 }
 
-void ShelfFilter::parameterChanged(const juce::String& parameterID, float newValue)
+BandSettings EqPTAudioProcessor::readBandSettings(int set, int band) const
 {
     using namespace Params;
-    using params = Params::Parameters;
+    auto value = [this, set, band](BandField field) { return getRawValue(bandParameter(band, field, set)); };
+
+    BandSettings settings;
+    settings.type = static_cast<BandType>(static_cast<int>(value(Field_Type)));
+    settings.freq = value(Field_Freq);
+    settings.gain = value(Field_Gain);
+    settings.q = value(Field_Q);
+    settings.slope = static_cast<CutSlope>(static_cast<int>(value(Field_Slope)));
+    settings.isBypassed = value(Field_Bypass) >= 0.5f;
+    return settings;
+}
 
-    if (parameterID == ParameterNames[params::LOW_SHELF_FREQ] && isLowShelf) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_SHELF_GAIN] && isLowShelf) {
-        gain = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_SHELF_Q] && isLowShelf) {
-        q = newValue;
-    }
-    if (parameterID == ParameterNames[params::LOW_SHELF_BYPASS] && isLowShelf) {
-        isBypassed = newValue;
+int EqPTAudioProcessor::getChannelSet(int channel) const
+{
+    switch (m_Globals.stereoMode) {
+    case Stereo_LeftRight:
+        return channel == 0 ? 0 : 1;
+    case Stereo_MidSide:
+        // Only the side channel gets the second set; channels past the pair are plain channels
+        return channel == 1 ? 1 : 0;
+    default:
+        return 0;
     }
+}
 
-    if (parameterID == ParameterNames[params::HIGH_SHELF_FREQ] && !isLowShelf) {
-        freq = newValue;
-    }
-    if (parameterID == ParameterNames[params::HIGH_SHELF_GAIN] && !isLowShelf) {
-        gain = newValue;
-    }
-    if (parameterID == ParameterNames[params::HIGH_SHELF_Q] && !isLowShelf) {
-        q = newValue;
-    }
-    if (parameterID == ParameterNames[params::HIGH_SHELF_BYPASS] && !isLowShelf) {
-        isBypassed = newValue;
+void EqPTAudioProcessor::markAllBandsChanged()
+{
+    for (auto& bands : m_Bands) {
+        for (auto& band : bands) {
+            band.paramsChanged = true;
+        }
     }
+}
+
+//==============================================================================
+// This creates new instances of the plugin..
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new EqPTAudioProcessor();
+}
 
+void Band::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(parameterID, newValue);
     paramsChanged = true;
 }
@@ -9,6 +9,10 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "BandArray.h"
+#include "RenderThreadPool.h"
+#include "EqMatcher.h"
+#include "ParameterKey.h"
 
 //==============================================================================
 /**
@@ -16,113 +20,171 @@
 
 namespace Params {
 
+    constexpr int maxBands = BandArray::maxBands;
+    constexpr int numChannelSets = BandArray::numDesignSets;
+
     enum class Parameters
     {
         OUT_GAIN,
         POLARITY_FLIP,
-        HPF_FREQ,
-        HPF_SLOPE,
-        HPF_BYPASS,
-        LOW_SHELF_FREQ,
-        LOW_SHELF_GAIN,
-        LOW_SHELF_Q,
-        LOW_SHELF_BYPASS,
-        LOW_MID_FREQ,
-        LOW_MID_GAIN,
-        LOW_MID_Q,
-        LOW_MID_BYPASS,
-        MID_FREQ,
-        MID_GAIN,
-        MID_Q,
-        MID_BYPASS,
-        HIGH_MID_FREQ,
-        HIGH_MID_GAIN,
-        HIGH_MID_Q,
-        HIGH_MID_BYPASS,
-        HIGH_SHELF_FREQ,
-        HIGH_SHELF_GAIN,
-        HIGH_SHELF_Q,
-        HIGH_SHELF_BYPASS,
-        LPF_FREQ,
-        LPF_SLOPE,
-        LPF_BYPASS,
+        FILTER_TOPOLOGY,
+        STEREO_MODE,
+        BAND_COUNT,
+        // Band parameters follow: numBandFields per band, maxBands per channel set, see bandParameter()
+        FIRST_BAND_PARAMETER,
     };
 
-    std::map<Parameters, juce::String> ParameterNames
+    enum BandField
     {
-        {Parameters::OUT_GAIN, "Out Gain"},
-        {Parameters::POLARITY_FLIP, "Polarity"},
-        {Parameters::HPF_FREQ, "HPF Freq"},
-        {Parameters::HPF_SLOPE, "HPF Slope"},
-        {Parameters::HPF_BYPASS, "HPF Bypass"},
-        {Parameters::LOW_SHELF_FREQ, "Low Shelf Freq"},
-        {Parameters::LOW_SHELF_GAIN, "Low Shelf Gain"},
-        {Parameters::LOW_SHELF_Q, "Low Shelf Q"},
-        {Parameters::LOW_SHELF_BYPASS, "Low Shelf Bypass"},
-        {Parameters::LOW_MID_FREQ, "Low-Mid Freq"},
-        {Parameters::LOW_MID_GAIN, "Low-Mid Gain"},
-        {Parameters::LOW_MID_Q, "Low-Mid Q"},
-        {Parameters::LOW_MID_BYPASS, "Low-Mid Bypass"},
-        {Parameters::MID_FREQ, "Mid Freq"},
-        {Parameters::MID_GAIN, "Mid Gain"},
-        {Parameters::MID_Q, "Mid Q"},
-        {Parameters::MID_BYPASS, "Mid Bypass"},
-        {Parameters::HIGH_MID_FREQ, "High-Mid Freq"},
-        {Parameters::HIGH_MID_GAIN, "High-Mid Gain"},
-        {Parameters::HIGH_MID_Q, "High-Mid Q"},
-        {Parameters::HIGH_MID_BYPASS, "High-Mid Bypass"},
-        {Parameters::HIGH_SHELF_FREQ, "High Shelf Freq"},
-        {Parameters::HIGH_SHELF_GAIN, "High Shelf Gain"},
-        {Parameters::HIGH_SHELF_Q, "High Shelf Q"},
-        {Parameters::HIGH_SHELF_BYPASS, "High Shelf Bypass"},
-        {Parameters::LPF_FREQ, "LPF Freq"},
-        {Parameters::LPF_SLOPE, "LPF Slope"},
-        {Parameters::LPF_BYPASS, "LPF Bypass"},
+        Field_Type,
+        Field_Freq,
+        Field_Gain,
+        Field_Q,
+        Field_Slope,
+        Field_Bypass,
+        numBandFields,
     };
-}
 
-enum CutSlope {
-    Slope_12 = 0,
-    Slope_24,
-    Slope_36,
-};
+    constexpr int numBandParameters = maxBands * numBandFields;
+    constexpr int numParameters = static_cast<int>(Parameters::FIRST_BAND_PARAMETER) + numChannelSets * numBandParameters;
 
+    constexpr Parameters bandParameter(int band, BandField field, int channelSet = 0)
+    {
+        return static_cast<Parameters>(static_cast<int>(Parameters::FIRST_BAND_PARAMETER) + channelSet * numBandParameters + band * numBandFields + field);
+    }
 
-enum Filters
-{
-	HPF, LF, LMF, MF, HMF, HF, LPF,
-};
+    // Maps a first-set band parameter onto the same parameter in the given channel set
+    constexpr Parameters forChannelSet(Parameters parameter, int channelSet)
+    {
+        return static_cast<Parameters>(static_cast<int>(parameter) + channelSet * numBandParameters);
+    }
 
-struct PeakFilter : public juce::dsp::IIR::Filter<float>, public juce::AudioProcessorValueTreeState::Listener
-{
-    float freq;
-    float gain{ 1.f };
-    float q{ 1.f };
-    Filters filterType;
-    bool isBypassed{ false };
-    void parameterChanged(const juce::String& parameterID, float newValue) override;
-    bool paramsChanged{ false };
+    constexpr bool isBandParameter(Parameters parameter)
+    {
+        return static_cast<int>(parameter) >= static_cast<int>(Parameters::FIRST_BAND_PARAMETER);
+    }
+
+    struct BandParameterInfo
+    {
+        int channelSet;
+        int band;
+        BandField field;
+    };
+
+    constexpr BandParameterInfo getBandParameterInfo(Parameters parameter)
+    {
+        const auto index = static_cast<int>(parameter) - static_cast<int>(Parameters::FIRST_BAND_PARAMETER);
+        return { index / numBandParameters, (index % numBandParameters) / numBandFields, static_cast<BandField>(index % numBandFields) };
+    }
+
+    // The fixed layout the band array replaced. New instances start out with it, and sessions saved with it load into it.
+    constexpr int numLegacyBands = 7;
+    constexpr std::array<BandType, numLegacyBands> legacyBandTypes{ Band_LowCut, Band_LowShelf, Band_Peak, Band_Peak, Band_Peak, Band_HighShelf, Band_HighCut };
+
+    // Those bands keep their old parameter IDs, so saved sessions and host automation still find them
+    constexpr const char* legacyBandParameterIDs[numLegacyBands][numBandFields]
+    {
+        { nullptr, "HPF Freq", nullptr, nullptr, "HPF Slope", "HPF Bypass" },
+        { nullptr, "Low Shelf Freq", "Low Shelf Gain", "Low Shelf Q", nullptr, "Low Shelf Bypass" },
+        { nullptr, "Low-Mid Freq", "Low-Mid Gain", "Low-Mid Q", nullptr, "Low-Mid Bypass" },
+        { nullptr, "Mid Freq", "Mid Gain", "Mid Q", nullptr, "Mid Bypass" },
+        { nullptr, "High-Mid Freq", "High-Mid Gain", "High-Mid Q", nullptr, "High-Mid Bypass" },
+        { nullptr, "High Shelf Freq", "High Shelf Gain", "High Shelf Q", nullptr, "High Shelf Bypass" },
+        { nullptr, "LPF Freq", nullptr, nullptr, "LPF Slope", "LPF Bypass" },
+    };
+
+    constexpr const char* bandFieldNames[numBandFields]{ "Type", "Freq", "Gain", "Q", "Slope", "Bypass" };
+
+    inline juce::String getChannelSetPrefix(int channelSet)
+    {
+        return channelSet > 0 ? "Ch2 " : "";
+    }
+
+    // Parameter IDs
+    inline std::map<Parameters, juce::String> ParameterNames = [] {
+        std::map<Parameters, juce::String> names
+        {
+            {Parameters::OUT_GAIN, "Out Gain"},
+            {Parameters::POLARITY_FLIP, "Polarity"},
+            {Parameters::FILTER_TOPOLOGY, "Filter Topology"},
+            {Parameters::STEREO_MODE, "Stereo Mode"},
+            {Parameters::BAND_COUNT, "Band Count"},
+        };
+        for (int set = 0; set < numChannelSets; ++set) {
+            for (int band = 0; band < maxBands; ++band) {
+                for (int field = 0; field < numBandFields; ++field) {
+                    const auto* legacyID = band < numLegacyBands ? legacyBandParameterIDs[band][field] : nullptr;
+                    const auto name = legacyID != nullptr
+                        ? juce::String(legacyID)
+                        : "Band " + juce::String(band + 1) + " " + bandFieldNames[field];
+                    names[bandParameter(band, static_cast<BandField>(field), set)] = getChannelSetPrefix(set) + name;
+                }
+            }
+        }
+        return names;
+    }();
+
+    // Parameters by the ParameterKey of their ID, for callers that carry keys rather than ID strings
+    inline const std::map<uint32_t, Parameters> ParameterKeys = [] {
+        std::map<uint32_t, Parameters> keys;
+        for (const auto& [parameter, name] : ParameterNames) {
+            const auto isUnique = keys.emplace(ParameterKey::fromID(name.toRawUTF8()), parameter).second;
+            jassert(isUnique);
+            juce::ignoreUnused(isUnique);
+        }
+        return keys;
+    }();
 
+    inline std::optional<Parameters> findParameter(uint32_t key)
+    {
+        const auto found = ParameterKeys.find(key);
+        return found != ParameterKeys.end() ? std::optional<Parameters>(found->second) : std::nullopt;
+    }
+
+    // What the host shows; uniform across bands, unlike the IDs
+    inline juce::String getParameterDisplayName(Parameters parameter)
+    {
+        if (!isBandParameter(parameter)) {
+            return ParameterNames[parameter];
+        }
+        const auto info = getBandParameterInfo(parameter);
+        return getChannelSetPrefix(info.channelSet) + "Band " + juce::String(info.band + 1) + " " + bandFieldNames[info.field];
+    }
+}
+
+
+enum StereoMode {
+    Stereo_Linked = 0,
+    Stereo_LeftRight,
+    Stereo_MidSide,
 };
-struct CutFilter : public juce::dsp::ProcessorChain<PeakFilter, PeakFilter, PeakFilter>, public juce::AudioProcessorValueTreeState::Listener
+
+// One band of one channel set. Its listener only flags the band; the audio thread reads the values itself.
+struct Band : public juce::AudioProcessorValueTreeState::Listener
 {
-    CutSlope slope{ Slope_24 };
-    bool isHPF;
-    bool isBypassed{ false };
-    float freq;
+    int index{ 0 };
+    int channelSet{ 0 };
     void parameterChanged(const juce::String& parameterID, float newValue) override;
-    bool paramsChanged{ false };
+    std::atomic<bool> paramsChanged{ true };
 };
-struct ShelfFilter : public juce::dsp::IIR::Filter<float>, public juce::AudioProcessorValueTreeState::Listener
+
+// The global parameters as the audio thread last took them over
+struct GlobalSettings
 {
-    float freq;
-    float gain{ 1.f };
-    float q{ 1.f };
-    bool isLowShelf;
-    bool isBypassed{ false };
-    void parameterChanged(const juce::String& parameterID, float newValue) override;
-    bool paramsChanged{ false };
+    float outputGain{ 0.f };
+    bool isPolarityFlipped{ false };
+    FilterTopology topology{ Topology_Biquad };
+    StereoMode stereoMode{ Stereo_Linked };
+    int numBands{ Params::numLegacyBands };
+};
 
+// A parameter change stamped with the sample it takes effect at, relative to the start of the next processed block.
+// Values are in the same (denormalised) units the tree state hands to its listeners.
+struct ParameterEvent
+{
+    Params::Parameters parameter;
+    float value;
+    int sampleOffset;
 };
 
 
@@ -169,22 +231,118 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    // Queues a sample-accurate parameter change for the next block. Must only be called from a single producer thread.
+    // The change is made through the parameter when its sample comes up, so the tree state and saved state follow it.
+    // JUCE's plugin wrappers hand the processor only the last value of each block, so the producer is a host that
+    // has the timestamps itself, such as the daemon forwarding its clients' events.
+    bool pushParameterEvent(Params::Parameters parameter, float value, int sampleOffset);
+    // Changes closer together than this are folded into one segment, bounding coefficient updates per block.
+    // The daemon takes it from each stream's configuration; the default is 32 samples.
+    void setMinimumSegmentLength(int numSamples);
+    // Captures input and reference spectra and fits the bands to them; results land on both band sets at once
+    EqMatcher& getMatcher() { return m_Matcher; }
+    // Called on the message thread once a match has been written to the parameters
+    std::function<void(const EqMatcher::Result&)> onMatchApplied;
 
     juce::AudioProcessorValueTreeState m_TreeState;
 private:
+    // Parameter objects in Params::Parameters order, so bulk access skips the ID lookups
+    std::array<juce::RangedAudioParameter*, Params::numParameters> m_Parameters;
+    std::array<std::atomic<float>*, Params::numParameters> m_RawValues;
+    std::array<juce::uint32, Params::numParameters> m_ParameterKeys;
+    float getRawValue(Params::Parameters parameter) const { return m_RawValues[static_cast<size_t>(parameter)]->load(); }
+
+    // State layout: magic, version, parameter count, then a ParameterKey and value per parameter.
+    // Keys do not depend on the parameter order, so parameters can be added or moved without a new version.
+    static constexpr int stateMagic = 0x54505145; // "EQPT"
+    static constexpr int stateVersion = 1;
+    using ParameterValues = std::array<std::optional<float>, Params::numParameters>;
+    bool readBinaryState(juce::MemoryInputStream& stream, ParameterValues& values) const;
+    bool readLegacyState(const void* data, int sizeInBytes, ParameterValues& values) const;
+    static void setLegacyLayout(ParameterValues& values);
+    void setParameterValues(const ParameterValues& values);
+
     //==============================================================================
 
     juce::AudioProcessorValueTreeState::ParameterLayout createLayout();
-    using MonoChain = juce::dsp::ProcessorChain<CutFilter, ShelfFilter, PeakFilter, PeakFilter, PeakFilter, ShelfFilter, CutFilter>;
-    std::array<MonoChain, 2> m_MonoChains;
+    // Each channel set's bands flag changes to their parameters; the band array holds what they design.
+    // Linked mode runs every channel on the first set. L/R runs the first channel on the first set and every
+    // other channel on the second; M/S runs only side on the second, so channels past the pair keep the first.
+    static constexpr int numChannelSets = Params::numChannelSets;
+    std::array<std::array<Band, Params::maxBands>, numChannelSets> m_Bands;
+    BandArray m_BandArray;
+    GlobalSettings m_Globals;
+    void initialiseBands();
+    void addBandListeners();
+    void removeBandListeners();
+    int getChannelSet(int channel) const;
+    void markAllBandsChanged();
+    int m_NumChannels{ numChannelSets };
+    float m_SegmentGain{ 1.f };
+    void processChannels(juce::dsp::AudioBlock<float>& block, int firstChannel, int numChannels);
+
+    // Mid/side encoding is folded into the first stage's read and decoding into the output write;
+    // only the filtered mid and side pass through small tiles
+    static constexpr int midSideTileSize = 256;
+    bool m_SegmentIsMidSide{ false };
+    void processMidSide(juce::dsp::AudioBlock<float>& block);
+
+    // Offline bounces with many channels spread channel groups over a worker pool
+    static constexpr int maxNumChannels = 64;
+    static constexpr int minChannelsForParallelRender = 4;
+    static constexpr int minSamplesForParallelRender = 256;
+    struct ChannelGroupJob : public RenderThreadPool::Job
+    {
+        explicit ChannelGroupJob(EqPTAudioProcessor& p) : processor(p) {}
+        void runJob(int index) override;
+        EqPTAudioProcessor& processor;
+        juce::dsp::AudioBlock<float>* block{ nullptr };
+        int numChannels{ 0 };
+        int channelsPerJob{ 1 };
+    };
+    std::unique_ptr<RenderThreadPool> m_RenderPool;
+    ChannelGroupJob m_ChannelGroupJob{ *this };
+
+    static constexpr int parameterEventQueueSize = 1024;
+    juce::AbstractFifo m_EventFifo{ parameterEventQueueSize };
+    std::array<ParameterEvent, parameterEventQueueSize> m_EventQueue;
+    std::vector<ParameterEvent> m_BlockEvents;
+    std::atomic<int> m_MinSegmentLength{ 32 };
+    void collectParameterEvents();
+    void applyParameterEvent(const ParameterEvent& event);
+    void processSegment(juce::dsp::AudioBlock<float>& block);
     void updateFilters();
-    void updateCutFilter(CutFilter& filter);
-    void updateCutFilterParams(CutFilter& filter);
-    void updatePeakFilter(PeakFilter& filter, int filterNo);
-    void updateShelfFilters();
-    juce::Array<PeakFilter*> getAllParametricFilters();
-    juce::Array<ShelfFilter*> getAllShelfFilters();
-    juce::Array<PeakFilter*> getAllFiltersFromCutFilter(const CutFilter&);
-    void updateParametricFilters();
+    BandSettings readBandSettings(int set, int band) const;
+    // Band values read in a pass, committed only if no parameter batch overlapped it
+    struct StagedBand
+    {
+        Band* band;
+        BandSettings settings;
+    };
+    std::array<StagedBand, numChannelSets * Params::maxBands> m_StagedBands;
+
+    EqMatcher m_Matcher;
+    void applyMatch(const EqMatcher::Result& result);
+
+    // Batches are opened on the message thread and make their sequence count odd while they write. The audio thread
+    // only takes over values it read under the same even count, so a batch lands whole, as one redesign.
+    std::atomic<juce::uint32> m_ParameterBatchSequence{ 0 };
+    int m_ParameterBatchDepth{ 0 };
+    struct ScopedParameterBatch
+    {
+        explicit ScopedParameterBatch(EqPTAudioProcessor& p) : processor(p)
+        {
+            if (processor.m_ParameterBatchDepth++ == 0) {
+                ++processor.m_ParameterBatchSequence;
+            }
+        }
+        ~ScopedParameterBatch()
+        {
+            if (--processor.m_ParameterBatchDepth == 0) {
+                ++processor.m_ParameterBatchSequence;
+            }
+        }
+        EqPTAudioProcessor& processor;
+    };
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EqPTAudioProcessor)
 };
@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    A small fixed pool used to fan a block's work out over several threads.
+
+  ==============================================================================
+*/
+
+#include "RenderThreadPool.h"
+
+class RenderThreadPool::Worker : public juce::Thread
+{
+public:
+    Worker(RenderThreadPool& pool, int index)
+        : juce::Thread("EqPT render worker " + juce::String(index)), m_Pool(pool)
+    {
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit()) {
+            wait(-1);
+            if (threadShouldExit()) {
+                break;
+            }
+            m_Pool.drain();
+            if (--m_Pool.m_BusyWorkers == 0) {
+                m_Pool.m_Finished.signal();
+            }
+        }
+    }
+
+private:
+    RenderThreadPool& m_Pool;
+};
+
+RenderThreadPool::RenderThreadPool(int numWorkers)
+{
+    for (int i = 0; i < numWorkers; ++i) {
+        m_Workers.add(new Worker(*this, i))->startThread();
+    }
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+    for (auto* worker : m_Workers) {
+        worker->signalThreadShouldExit();
+        worker->notify();
+    }
+    for (auto* worker : m_Workers) {
+        worker->stopThread(1000);
+    }
+}
+
+void RenderThreadPool::run(Job& job, int numJobs)
+{
+    if (m_Workers.isEmpty() || numJobs <= 1) {
+        for (int i = 0; i < numJobs; ++i) {
+            job.runJob(i);
+        }
+        return;
+    }
+
+    m_Job = &job;
+    m_NumJobs = numJobs;
+    m_BusyWorkers = m_Workers.size();
+    m_NextJob = 0;
+    for (auto* worker : m_Workers) {
+        worker->notify();
+    }
+
+    drain();
+
+    // Every worker checks in once per run, so none of them can still be touching this job afterwards
+    m_Finished.wait(-1);
+    m_Job = nullptr;
+}
+
+void RenderThreadPool::drain()
+{
+    for (auto index = m_NextJob.fetch_add(1); index < m_NumJobs; index = m_NextJob.fetch_add(1)) {
+        m_Job->runJob(index);
+    }
+}
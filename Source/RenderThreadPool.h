@@ -0,0 +1,45 @@
+/*
+  ==============================================================================
+
+    A small fixed pool used to fan a block's work out over several threads.
+    Jobs are claimed from a shared counter by the workers and by the calling
+    thread alike, so whoever finishes early picks up the remaining work, and
+    run() returns only once every job has completed.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class RenderThreadPool
+{
+public:
+    struct Job
+    {
+        virtual ~Job() = default;
+        virtual void runJob(int index) = 0;
+    };
+
+    explicit RenderThreadPool(int numWorkers);
+    ~RenderThreadPool();
+
+    int getNumWorkers() const { return m_Workers.size(); }
+
+    // Calls job.runJob(i) for every i in [0, numJobs) and blocks until all of them have returned.
+    void run(Job& job, int numJobs);
+
+private:
+    class Worker;
+    void drain();
+
+    juce::OwnedArray<Worker> m_Workers;
+    Job* m_Job{ nullptr };
+    int m_NumJobs{ 0 };
+    std::atomic<int> m_NextJob{ 0 };
+    std::atomic<int> m_BusyWorkers{ 0 };
+    juce::WaitableEvent m_Finished;
+
+    JUCE_DECLARE_NON_COPYABLE(RenderThreadPool)
+};
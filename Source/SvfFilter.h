@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    Trapezoidal-integrated (TPT) state variable filter, after Andrew Simper's
+    "Linear Trap Optimised SVF". Unlike the direct-form biquads, its state is
+    stored as integrator charges, so it stays stable and click-free when the
+    coefficients move every sample, and it keeps its precision at very low
+    cutoffs in single precision.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Band shape for the SVF: out = m0 * input + m1 * bandpass + m2 * lowpass.
+// Gain factors are linear, matching juce::dsp::IIR::Coefficients.
+struct SvfCoefficients
+{
+    float g{ 0.f };
+    float k{ 2.f };
+    float m0{ 1.f };
+    float m1{ 0.f };
+    float m2{ 0.f };
+
+    static SvfCoefficients makeLowPass(double sampleRate, float frequency)
+    {
+        return { prewarp(sampleRate, frequency), juce::MathConstants<float>::sqrt2, 0.f, 0.f, 1.f };
+    }
+
+    static SvfCoefficients makeHighPass(double sampleRate, float frequency)
+    {
+        const auto k = juce::MathConstants<float>::sqrt2;
+        return { prewarp(sampleRate, frequency), k, 1.f, -k, -1.f };
+    }
+
+    static SvfCoefficients makePeakFilter(double sampleRate, float frequency, float q, float gainFactor)
+    {
+        const auto A = std::sqrt(juce::jmax(gainFactor, 1.0e-6f));
+        const auto k = 1.f / (q * A);
+        return { prewarp(sampleRate, frequency), k, 1.f, k * (A * A - 1.f), 0.f };
+    }
+
+    static SvfCoefficients makeLowShelf(double sampleRate, float frequency, float q, float gainFactor)
+    {
+        const auto A = std::sqrt(juce::jmax(gainFactor, 1.0e-6f));
+        const auto k = 1.f / q;
+        return { prewarp(sampleRate, frequency) / std::sqrt(A), k, 1.f, k * (A - 1.f), A * A - 1.f };
+    }
+
+    static SvfCoefficients makeHighShelf(double sampleRate, float frequency, float q, float gainFactor)
+    {
+        const auto A = std::sqrt(juce::jmax(gainFactor, 1.0e-6f));
+        const auto k = 1.f / q;
+        return { prewarp(sampleRate, frequency) * std::sqrt(A), k, A * A, k * (1.f - A) * A, 1.f - A * A };
+    }
+
+    static SvfCoefficients makeNotch(double sampleRate, float frequency, float q)
+    {
+        const auto k = 1.f / q;
+        return { prewarp(sampleRate, frequency), k, 1.f, -k, 0.f };
+    }
+
+    // A low shelf cut by the full gain and lifted by half of it, so lows and highs move in opposite directions around the pivot
+    static SvfCoefficients makeTilt(double sampleRate, float frequency, float q, float gainFactor)
+    {
+        auto c = makeLowShelf(sampleRate, frequency, q, 1.f / juce::jmax(gainFactor, 1.0e-6f));
+        const auto lift = std::sqrt(juce::jmax(gainFactor, 1.0e-6f));
+        c.m0 *= lift;
+        c.m1 *= lift;
+        c.m2 *= lift;
+        return c;
+    }
+
+    bool operator==(const SvfCoefficients& other) const
+    {
+        return g == other.g && k == other.k && m0 == other.m0 && m1 == other.m1 && m2 == other.m2;
+    }
+
+    static float prewarp(double sampleRate, float frequency)
+    {
+        const auto nyquistSafe = juce::jmin(static_cast<double>(frequency), sampleRate * 0.49);
+        return static_cast<float>(std::tan(juce::MathConstants<double>::pi * nyquistSafe / sampleRate));
+    }
+};
+
+// Single-channel filter with its state and coefficient ramp held inline, so arrays of them stay contiguous.
+class SvfFilter
+{
+public:
+    static constexpr double rampTimeSeconds = 0.001;
+
+    void reset() noexcept
+    {
+        m_State = { 0.f, 0.f };
+        m_Current = m_Target;
+        m_RampRemaining = 0;
+        m_IsFirstUpdate = true;
+        updateGains();
+    }
+
+    // Moves towards the new shape over a short linear ramp; the first update after a reset is applied at once.
+    void setCoefficients(const SvfCoefficients& target, int rampLength) noexcept
+    {
+        if (!m_IsFirstUpdate && target == m_Target) {
+            return;
+        }
+        m_Target = target;
+        if (m_IsFirstUpdate) {
+            m_Current = target;
+            m_RampRemaining = 0;
+            m_IsFirstUpdate = false;
+            updateGains();
+            return;
+        }
+        m_RampRemaining = juce::jmax(1, rampLength);
+        const auto steps = static_cast<float>(m_RampRemaining);
+        m_Delta = { (target.g - m_Current.g) / steps, (target.k - m_Current.k) / steps,
+                    (target.m0 - m_Current.m0) / steps, (target.m1 - m_Current.m1) / steps, (target.m2 - m_Current.m2) / steps };
+    }
+
+    // input(i) supplies the i-th sample and may read from output, which is written at the same index afterwards
+    template <typename Input>
+    void process(Input& input, float* output, int numSamples, float gain) noexcept
+    {
+        // Per-sample coefficient interpolation only while a ramp is running
+        int i = 0;
+        for (; i < numSamples && m_RampRemaining > 0; ++i) {
+            stepRamp();
+            output[i] = gain * processSample(input(i));
+        }
+        for (; i < numSamples; ++i) {
+            output[i] = gain * processSample(input(i));
+        }
+        juce::dsp::util::snapToZero(m_State[0]);
+        juce::dsp::util::snapToZero(m_State[1]);
+    }
+
+private:
+    float processSample(float v0) noexcept
+    {
+        const auto v3 = v0 - m_State[1];
+        const auto v1 = m_A1 * m_State[0] + m_A2 * v3;
+        const auto v2 = m_State[1] + m_A2 * m_State[0] + m_A3 * v3;
+        m_State[0] = 2.f * v1 - m_State[0];
+        m_State[1] = 2.f * v2 - m_State[1];
+        return m_Current.m0 * v0 + m_Current.m1 * v1 + m_Current.m2 * v2;
+    }
+
+    void stepRamp() noexcept
+    {
+        if (--m_RampRemaining == 0) {
+            m_Current = m_Target;
+        }
+        else {
+            m_Current.g += m_Delta.g;
+            m_Current.k += m_Delta.k;
+            m_Current.m0 += m_Delta.m0;
+            m_Current.m1 += m_Delta.m1;
+            m_Current.m2 += m_Delta.m2;
+        }
+        updateGains();
+    }
+
+    void updateGains() noexcept
+    {
+        m_A1 = 1.f / (1.f + m_Current.g * (m_Current.g + m_Current.k));
+        m_A2 = m_Current.g * m_A1;
+        m_A3 = m_Current.g * m_A2;
+    }
+
+    std::array<float, 2> m_State{};
+    SvfCoefficients m_Current, m_Target, m_Delta;
+    float m_A1{ 1.f }, m_A2{ 0.f }, m_A3{ 0.f };
+    int m_RampRemaining{ 0 };
+    bool m_IsFirstUpdate{ true };
+};